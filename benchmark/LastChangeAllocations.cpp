@@ -0,0 +1,271 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+/*
+ * Allocations and time per AVTransport LastChange event through the event path before and after decoding and parsing the event in place.
+ *
+ * The old path is the code that was used before: the envelope is parsed, the LastChange value is copied and unescaped into a new string and that
+ * string is trimmed and parsed again, copying every name and value into a string map. All metadata documents are decoded right away. The new path
+ * is the current code in EventServer and SonosPacket. As metadata documents are decoded on first access now, the new path is measured with and
+ * without accessing them.
+ */
+
+#include "AllocationCounter.h"
+#include "../src/GD.h"
+#include "../src/SonosPacket.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace Sonos;
+
+namespace
+{
+
+//An AVTransport event as sent by a Play:1 when a track starts. The metadata is escaped once, as in the event document.
+const char* recordedEvent =
+	"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/AVT/\" xmlns:r=\"urn:schemas-rinconnetworks-com:metadata-1-0/\"><InstanceID val=\"0\">"
+	"<TransportState val=\"PLAYING\"/><CurrentPlayMode val=\"NORMAL\"/><CurrentCrossfadeMode val=\"0\"/><NumberOfTracks val=\"12\"/>"
+	"<CurrentTrack val=\"3\"/><CurrentSection val=\"0\"/><CurrentTrackURI val=\"x-file-cifs://nas/music/Artist/Album/03%20Track.flac\"/>"
+	"<CurrentTrackDuration val=\"0:04:12\"/>"
+	"<CurrentTrackMetaData val=\"&lt;DIDL-Lite xmlns:dc=&quot;http://purl.org/dc/elements/1.1/&quot; xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/&quot; "
+	"xmlns:r=&quot;urn:schemas-rinconnetworks-com:metadata-1-0/&quot; xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/&quot;&gt;"
+	"&lt;item id=&quot;-1&quot; parentID=&quot;-1&quot; restricted=&quot;true&quot;&gt;&lt;res protocolInfo=&quot;x-file-cifs:*:audio/flac:*&quot; "
+	"duration=&quot;0:04:12&quot;&gt;x-file-cifs://nas/music/Artist/Album/03%20Track.flac&lt;/res&gt;&lt;r:streamContent&gt;&lt;/r:streamContent&gt;"
+	"&lt;upnp:albumArtURI&gt;/getaa?u=x-file-cifs%3a%2f%2fnas%2fmusic%2fArtist%2fAlbum%2f03%2520Track.flac&amp;amp;v=432&lt;/upnp:albumArtURI&gt;"
+	"&lt;dc:title&gt;Track Three&lt;/dc:title&gt;&lt;upnp:class&gt;object.item.audioItem.musicTrack&lt;/upnp:class&gt;&lt;dc:creator&gt;Artist&lt;/dc:creator&gt;"
+	"&lt;upnp:album&gt;Album&lt;/upnp:album&gt;&lt;upnp:originalTrackNumber&gt;3&lt;/upnp:originalTrackNumber&gt;&lt;/item&gt;&lt;/DIDL-Lite&gt;\"/>"
+	"<r:NextTrackURI val=\"x-file-cifs://nas/music/Artist/Album/04%20Track.flac\"/>"
+	"<r:NextTrackMetaData val=\"&lt;DIDL-Lite xmlns:dc=&quot;http://purl.org/dc/elements/1.1/&quot; xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/&quot; "
+	"xmlns:r=&quot;urn:schemas-rinconnetworks-com:metadata-1-0/&quot; xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/&quot;&gt;"
+	"&lt;item id=&quot;-1&quot; parentID=&quot;-1&quot; restricted=&quot;true&quot;&gt;&lt;res protocolInfo=&quot;x-file-cifs:*:audio/flac:*&quot; "
+	"duration=&quot;0:03:48&quot;&gt;x-file-cifs://nas/music/Artist/Album/04%20Track.flac&lt;/res&gt;&lt;dc:title&gt;Track Four&lt;/dc:title&gt;"
+	"&lt;upnp:class&gt;object.item.audioItem.musicTrack&lt;/upnp:class&gt;&lt;dc:creator&gt;Artist&lt;/dc:creator&gt;&lt;upnp:album&gt;Album&lt;/upnp:album&gt;"
+	"&lt;/item&gt;&lt;/DIDL-Lite&gt;\"/>"
+	"<r:EnqueuedTransportURI val=\"x-rincon-playlist:RINCON_000E58000001400#A:ALBUM/Album\"/>"
+	"<r:EnqueuedTransportURIMetaData val=\"&lt;DIDL-Lite xmlns:dc=&quot;http://purl.org/dc/elements/1.1/&quot; xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/&quot; "
+	"xmlns:r=&quot;urn:schemas-rinconnetworks-com:metadata-1-0/&quot; xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/&quot;&gt;"
+	"&lt;item id=&quot;A:ALBUM/Album&quot; parentID=&quot;A:ALBUM&quot; restricted=&quot;true&quot;&gt;&lt;dc:title&gt;Album&lt;/dc:title&gt;"
+	"&lt;upnp:class&gt;object.container.album.musicAlbum&lt;/upnp:class&gt;&lt;/item&gt;&lt;/DIDL-Lite&gt;\"/>"
+	"<PlaybackStorageMedium val=\"NETWORK\"/><AVTransportURI val=\"x-rincon-queue:RINCON_000E58000001400#0\"/><AVTransportURIMetaData val=\"\"/>"
+	"<NextAVTransportURI val=\"\"/><NextAVTransportURIMetaData val=\"\"/><CurrentTransportActions val=\"Set, Stop, Pause, Seek, Next, Previous\"/>"
+	"<r:CurrentValidPlayModes val=\"SHUFFLE,REPEAT,REPEATONE,CROSSFADE\"/><r:DirectControlClientID val=\"\"/><r:DirectControlIsSuspended val=\"0\"/>"
+	"<r:DirectControlAccountID val=\"\"/><TransportStatus val=\"OK\"/><r:SleepTimerGeneration val=\"0\"/><r:AlarmRunning val=\"0\"/>"
+	"<r:SnoozeRunning val=\"0\"/><r:RestartPending val=\"0\"/><TransportPlaySpeed val=\"NOT_IMPLEMENTED\"/><CurrentMediaDuration val=\"NOT_IMPLEMENTED\"/>"
+	"<RecordStorageMedium val=\"NOT_IMPLEMENTED\"/><PossiblePlaybackStorageMedia val=\"NONE, NETWORK\"/><PossibleRecordStorageMedia val=\"NOT_IMPLEMENTED\"/>"
+	"<RecordMediumWriteStatus val=\"NOT_IMPLEMENTED\"/><CurrentRecordQualityMode val=\"NOT_IMPLEMENTED\"/><PossibleRecordQualityModes val=\"NOT_IMPLEMENTED\"/>"
+	"</InstanceID></Event>";
+
+const std::string serialNumber = "000E58000001";
+
+std::string escape(const std::string& data)
+{
+	std::string result;
+	result.reserve(data.size() * 2);
+	for(char c : data)
+	{
+		if(c == '<') result.append("&lt;");
+		else if(c == '>') result.append("&gt;");
+		else if(c == '&') result.append("&amp;");
+		else if(c == '"') result.append("&quot;");
+		else result.push_back(c);
+	}
+	return result;
+}
+
+/**
+ * The part of the old SonosPacket handling info packets.
+ */
+class OldPacket : public BaseLib::Systems::Packet
+{
+public:
+	typedef std::shared_ptr<std::unordered_map<std::string, std::string>> PMap;
+
+	explicit OldPacket(std::string& soap)
+	{
+		BaseLib::HelperFunctions::trim(soap);
+		_values.reset(new std::unordered_map<std::string, std::string>());
+		_valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
+		if(soap.empty()) return;
+		xml_document doc;
+		doc.parse<parse_no_entity_translation>(&soap.at(0));
+		xml_node* node = doc.first_node("Event");
+		if(!node) return;
+		_functionName = "InfoBroadcast";
+		node = node->first_node("InstanceID");
+		if(!node) return;
+		for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
+		{
+			std::string name(subNode->name());
+			xml_attribute* attr = subNode->first_attribute("val");
+			xml_attribute* channel = subNode->first_attribute("channel");
+			if(channel) name.append(std::string(channel->value()));
+			if(!attr) continue;
+			std::string value(attr->value());
+			_values->operator [](name) = value;
+			if(name == "CurrentTrackMetaData" || name == "TrackMetaData") _currentTrackMetadata = parseMetadata(value, true);
+			else if(name == "r:NextTrackMetaData") _nextTrackMetadata = parseMetadata(value, true);
+			else if(name == "AVTransportURIMetaData") _avTransportUriMetaData = parseMetadata(value, false);
+			else if(name == "NextAVTransportURIMetaData") _nextAvTransportUriMetaData = parseMetadata(value, false);
+			else if(name == "r:EnqueuedTransportURIMetaData") _enqueuedTransportUriMetaData = parseMetadata(value, false);
+		}
+	}
+private:
+	std::string _functionName;
+	std::shared_ptr<std::vector<std::pair<std::string, std::string>>> _valuesToSet;
+	PMap _values;
+	PMap _currentTrackMetadata;
+	PMap _nextTrackMetadata;
+	PMap _avTransportUriMetaData;
+	PMap _nextAvTransportUriMetaData;
+	PMap _enqueuedTransportUriMetaData;
+
+	static PMap parseMetadata(std::string& value, bool resAttributes)
+	{
+		PMap metadata = std::make_shared<std::unordered_map<std::string, std::string>>();
+		if(value.empty()) return metadata;
+		std::string xml;
+		BaseLib::Html::unescapeHtmlEntities(value, xml);
+		xml_document metadataDoc;
+		metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
+		xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
+		if(!metadataNode) return metadata;
+		metadataNode = metadataNode->first_node("item");
+		if(!metadataNode) return metadata;
+		for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
+		{
+			metadata->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
+		}
+		for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
+		{
+			std::string metadataName(metadataSubNode->name());
+			metadata->operator [](std::string(metadataSubNode->name())) = std::string(metadataSubNode->value());
+			if(resAttributes && metadataName == "res")
+			{
+				for(xml_attribute* metadataAttribute = metadataSubNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
+				{
+					metadata->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
+				}
+			}
+		}
+		return metadata;
+	}
+};
+
+/**
+ * The old event path from EventServer::readClient(). The request body is parsed in place, so "body" is a fresh copy for every run.
+ */
+void oldPath(std::vector<char>& body)
+{
+	xml_document doc;
+	doc.parse<parse_no_entity_translation>(body.data());
+	for(xml_node* node = doc.first_node(); node; node = node->next_sibling())
+	{
+		std::string name(node->name());
+		if(name != "e:propertyset") continue;
+		for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
+		{
+			std::string subNodeName(subNode->name());
+			if(subNodeName != "e:property" || !subNode->first_node() || std::string(subNode->first_node()->name()) != "LastChange") continue;
+			std::string xml;
+			for(xml_node* propertyNode = subNode->first_node(); propertyNode; propertyNode = propertyNode->next_sibling())
+			{
+				std::string value(propertyNode->value());
+				BaseLib::Html::unescapeHtmlEntities(value, xml);
+				std::shared_ptr<OldPacket> packet(new OldPacket(xml));
+			}
+		}
+	}
+}
+
+/**
+ * The current event path: EventServer::readClient() copies the body into a shared buffer, EventServer::processNotifyData() creates the packets.
+ */
+void newPath(const std::vector<char>& received, bool accessMetadata)
+{
+	auto content = std::make_shared<std::vector<char>>();
+	content->reserve(received.size());
+	content->insert(content->end(), received.begin(), received.end());
+
+	xml_document doc;
+	doc.parse<parse_no_entity_translation>(content->data());
+	for(xml_node* node = doc.first_node(); node; node = node->next_sibling())
+	{
+		std::string name(node->name());
+		if(name != "e:propertyset") continue;
+		for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
+		{
+			std::string subNodeName(subNode->name());
+			if(subNodeName != "e:property" || !subNode->first_node() || std::string(subNode->first_node()->name()) != "LastChange") continue;
+			for(xml_node* propertyNode = subNode->first_node(); propertyNode; propertyNode = propertyNode->next_sibling())
+			{
+				std::shared_ptr<SonosPacket> packet(new SonosPacket(content, propertyNode->value(), propertyNode->value_size(), serialNumber));
+				if(!accessMetadata) continue;
+				for(int32_t i = 0; i < (int32_t)SonosPacket::MetadataType::count; i++)
+				{
+					packet->metadata((SonosPacket::MetadataType)i);
+				}
+			}
+		}
+	}
+}
+
+template<typename Function> void measure(const std::string& name, int32_t runs, Function function)
+{
+	uint64_t allocations = AllocationCounter::allocations();
+	auto start = std::chrono::steady_clock::now();
+	for(int32_t i = 0; i < runs; i++)
+	{
+		function();
+	}
+	auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	allocations = AllocationCounter::allocations() - allocations;
+	std::cout << name << ": " << (double)allocations / runs << " allocations, " << (double)duration / runs / 1000 << " us per event" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	int32_t runs = argc > 1 ? std::stoi(argv[1]) : 10000;
+
+	std::string body = "<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\"><e:property><LastChange>" + escape(recordedEvent) + "</LastChange></e:property></e:propertyset>";
+	std::vector<char> received(body.begin(), body.end());
+	received.push_back(0);
+	std::cout << "Event size: " << body.size() << " bytes, " << runs << " runs" << std::endl;
+
+	//The old path modifies the body, so it gets a fresh copy for every run. The copies are made before measuring.
+	std::vector<std::vector<char>> copies(runs, received);
+	size_t copyIndex = 0;
+	measure("Old path", runs, [&]() { oldPath(copies.at(copyIndex++)); });
+	measure("New path", runs, [&]() { newPath(received, false); });
+	measure("New path with metadata access", runs, [&]() { newPath(received, true); });
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+/*
+ * Allocations and time per received value through SonosPeer::convertReceivedValue() with and without direct conversion.
+ *
+ * Without direct conversion the value is parsed, encoded, decoded and encoded again by the parameter's casts, and packetReceived() decodes the
+ * stored binary value once more. With direct conversion the value is parsed and encoded once and packetReceived() uses the parsed variable. One
+ * parameter of each type handled by DispatchPlan::canConvertDirectly() is measured, taken from the module's device description.
+ */
+
+#include "AllocationCounter.h"
+#include "../src/GD.h"
+#include "../src/SonosPeer.h"
+#include "../src/DispatchPlan.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace Sonos;
+
+namespace
+{
+
+PParameter findParameter(const std::shared_ptr<BaseLib::DeviceDescription::HomegearDevice>& device, const std::string& id)
+{
+	for(auto& function : device->functions)
+	{
+		for(auto type : { ParameterGroup::Type::Enum::variables, ParameterGroup::Type::Enum::config })
+		{
+			PParameterGroup parameterGroup = function.second->getParameterGroup(type);
+			if(!parameterGroup) continue;
+			PParameter parameter = parameterGroup->getParameter(id);
+			if(parameter && DispatchPlan::canConvertDirectly(parameter)) return parameter;
+		}
+	}
+	return PParameter();
+}
+
+PVariable createBrowseResult(int32_t size)
+{
+	PVariable browseResult(new Variable(VariableType::tArray));
+	browseResult->arrayValue->reserve(size);
+	for(int32_t i = 0; i < size; i++)
+	{
+		std::string index = std::to_string(i);
+		PVariable item(new Variable(VariableType::tStruct));
+		item->structValue->insert(StructElement("TITLE", PVariable(new Variable("Favorite " + index))));
+		item->structValue->insert(StructElement("ARTIST", PVariable(new Variable(std::string("Artist")))));
+		item->structValue->insert(StructElement("ALBUMART", PVariable(new Variable("/getaa?s=1&u=x-sonosapi-stream%3as" + index))));
+		item->structValue->insert(StructElement("AV_TRANSPORT_URI", PVariable(new Variable("x-sonosapi-stream:s" + index + "?sid=254&flags=8224&sn=0"))));
+		item->structValue->insert(StructElement("AV_TRANSPORT_URI_METADATA", PVariable(new Variable("<DIDL-Lite><item id=\"F00092020s" + index + "\"><dc:title>Favorite " + index + "</dc:title></item></DIDL-Lite>"))));
+		browseResult->arrayValue->push_back(item);
+	}
+	return browseResult;
+}
+
+/**
+ * Converts the value like SonosPeer::getValuesFromPacket() and gets the variable raised by SonosPeer::packetReceived().
+ */
+PVariable convert(BaseLib::Rpc::RpcEncoder& binaryEncoder, const PParameter& parameter, bool directConversion, std::string_view value, const PVariable& browseResult)
+{
+	FrameValue frameValue;
+	SonosPeer::convertReceivedValue(binaryEncoder, parameter, directConversion, value, browseResult, frameValue);
+	return frameValue.variable ? frameValue.variable : parameter->convertFromPacket(frameValue.value, BaseLib::DeviceDescription::Role(), true);
+}
+
+void measure(BaseLib::Rpc::RpcEncoder& binaryEncoder, const PParameter& parameter, const std::string& value, const PVariable& browseResult, int32_t runs)
+{
+	for(bool directConversion : { false, true })
+	{
+		uint64_t allocations = AllocationCounter::allocations();
+		auto start = std::chrono::steady_clock::now();
+		for(int32_t i = 0; i < runs; i++)
+		{
+			convert(binaryEncoder, parameter, directConversion, value, browseResult);
+		}
+		auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		allocations = AllocationCounter::allocations() - allocations;
+		std::cout << parameter->id << (directConversion ? " (direct)" : " (casts)") << ": " << (double)allocations / runs << " allocations, " << (double)duration / runs << " ns per value" << std::endl;
+	}
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	std::string filename = argc > 1 ? argv[1] : DEVICE_DESCRIPTION;
+	int32_t runs = argc > 2 ? std::stoi(argv[2]) : 100000;
+
+	std::unique_ptr<BaseLib::SharedObjects> bl(new BaseLib::SharedObjects());
+	GD::bl = bl.get();
+	GD::out.init(bl.get());
+
+	bool oldFormat = false;
+	auto device = std::make_shared<BaseLib::DeviceDescription::HomegearDevice>(bl.get(), filename, oldFormat);
+	BaseLib::Rpc::RpcEncoder binaryEncoder(bl.get());
+
+	//The values are what a Play:1 sends. FAVORITES is set from a browse result, so the string value is not used.
+	std::vector<std::tuple<std::string, std::string, PVariable>> values
+	{
+		std::make_tuple("CURRENT_TRACK_URI", "x-file-cifs://nas/music/Artist/Album/03%20Track.flac", PVariable()),
+		std::make_tuple("VOLUME", "23", PVariable()),
+		std::make_tuple("PLAY_TTS_UNMUTE", "1", PVariable()),
+		std::make_tuple("FAVORITES", "", createBrowseResult(20))
+	};
+
+	for(auto& value : values)
+	{
+		PParameter parameter = findParameter(device, std::get<0>(value));
+		if(!parameter)
+		{
+			std::cerr << "No directly convertible parameter " << std::get<0>(value) << " in " << filename << "." << std::endl;
+			return 1;
+		}
+		PVariable direct = convert(binaryEncoder, parameter, true, std::get<1>(value), std::get<2>(value));
+		PVariable casts = convert(binaryEncoder, parameter, false, std::get<1>(value), std::get<2>(value));
+		if(*direct != *casts)
+		{
+			std::cerr << "Direct conversion of " << parameter->id << " differs: " << direct->print(false, false, true) << " != " << casts->print(false, false, true) << std::endl;
+			return 1;
+		}
+		measure(binaryEncoder, parameter, std::get<1>(value), std::get<2>(value), std::get<2>(value) ? runs / 10 : runs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "DispatchPlan.h"
+#include "GD.h"
+
+namespace Sonos
+{
+
+std::mutex DispatchPlan::_plansMutex;
+std::unordered_map<BaseLib::DeviceDescription::HomegearDevice*, std::weak_ptr<DispatchPlan>> DispatchPlan::_plans;
+
+DispatchPlan::DispatchPlan(const std::shared_ptr<BaseLib::DeviceDescription::HomegearDevice>& device)
+{
+	try
+	{
+		using namespace BaseLib::DeviceDescription;
+
+		if(!device) return;
+		_device = device;
+		std::unordered_map<std::string, std::string_view> keys;
+		for(PacketsByFunction::iterator i = device->packetsByFunction2.begin(); i != device->packetsByFunction2.end(); ++i)
+		{
+			PPacket frame(i->second);
+			if(!frame) continue;
+			if(frame->direction != Packet::Direction::Enum::toCentral) continue;
+
+			Function& function = _functions[i->first];
+			size_t frameIndex = function.frameIds.size();
+			function.frameIds.push_back(frame->id);
+
+			int32_t startChannel = (frame->channel < 0) ? 0 : frame->channel;
+			int32_t endChannel = startChannel;
+			//When fixedChannel is -2 (means '*') cycle through all channels
+			if(frame->channel == -2)
+			{
+				startChannel = 0;
+				endChannel = device->functions.empty() ? 0 : device->functions.rbegin()->first;
+			}
+
+			for(JsonPayloads::iterator j = frame->jsonPayloads.begin(); j != frame->jsonPayloads.end(); ++j)
+			{
+				Entry entry;
+				entry.frameIndex = frameIndex;
+				if(!(*j)->subkey.empty())
+				{
+					entry.metadataType = metadataTypeFromKey((*j)->key);
+					//Subkeys are only supported for metadata documents. For all other keys the value itself is used.
+					if(entry.metadataType != SonosPacket::MetadataType::count) entry.subkey = (*j)->subkey;
+				}
+
+				for(std::vector<PParameter>::iterator k = frame->associatedVariables.begin(); k != frame->associatedVariables.end(); ++k)
+				{
+					if((*k)->physical->groupId != (*j)->parameterId) continue;
+					Target target;
+					target.parameter = *k;
+					target.parameterSetType = (*k)->parent()->type();
+					target.directConversion = canConvertDirectly(*k);
+					for(int32_t l = startChannel; l <= endChannel; l++)
+					{
+						Functions::iterator functionIterator = device->functions.find(l);
+						if(functionIterator == device->functions.end()) continue;
+						PParameterGroup parameterGroup = functionIterator->second->getParameterGroup(target.parameterSetType);
+						if(!parameterGroup || parameterGroup->parameters.find((*k)->id) == parameterGroup->parameters.end()) continue;
+						target.channels.push_back(l);
+					}
+					if(!target.channels.empty()) entry.targets.push_back(target);
+				}
+				if(entry.targets.empty()) continue;
+
+				auto keyIterator = keys.find((*j)->key);
+				if(keyIterator == keys.end())
+				{
+					_keys.push_back((*j)->key);
+					keyIterator = keys.emplace((*j)->key, std::string_view(_keys.back())).first;
+				}
+				function.entriesByKey[keyIterator->second].push_back(std::move(entry));
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+std::shared_ptr<DispatchPlan> DispatchPlan::get(const std::shared_ptr<BaseLib::DeviceDescription::HomegearDevice>& device)
+{
+	try
+	{
+		if(!device) return std::shared_ptr<DispatchPlan>();
+		std::lock_guard<std::mutex> plansGuard(_plansMutex);
+		auto planIterator = _plans.find(device.get());
+		if(planIterator != _plans.end())
+		{
+			std::shared_ptr<DispatchPlan> plan = planIterator->second.lock();
+			//A deleted description's address can be reused by a new one, so check that the plan was created for this description.
+			if(plan && plan->isFor(device)) return plan;
+		}
+
+		for(auto i = _plans.begin(); i != _plans.end();)
+		{
+			if(i->second.expired()) i = _plans.erase(i);
+			else ++i;
+		}
+
+		auto plan = std::make_shared<DispatchPlan>(device);
+		_plans[device.get()] = plan;
+		return plan;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return std::shared_ptr<DispatchPlan>();
+}
+
+SonosPacket::MetadataType DispatchPlan::metadataTypeFromKey(const std::string& key)
+{
+	if(key == "CurrentTrackMetaData" || key == "TrackMetaData") return SonosPacket::MetadataType::currentTrack;
+	else if(key == "r:NextTrackMetaData") return SonosPacket::MetadataType::nextTrack;
+	else if(key == "AVTransportURIMetaData") return SonosPacket::MetadataType::avTransportUri;
+	else if(key == "NextAVTransportURIMetaData") return SonosPacket::MetadataType::nextAvTransportUri;
+	else if(key == "r:EnqueuedTransportURIMetaData") return SonosPacket::MetadataType::enqueuedTransportUri;
+	return SonosPacket::MetadataType::count;
+}
+
+bool DispatchPlan::canConvertDirectly(const BaseLib::DeviceDescription::PParameter& parameter)
+{
+	using namespace BaseLib::DeviceDescription;
+
+	if(!parameter || !parameter->logical || !parameter->physical) return false;
+	if(parameter->casts.size() != 1 || !std::dynamic_pointer_cast<ParameterCast::RpcBinary>(parameter->casts.front())) return false;
+	switch(parameter->logical->type)
+	{
+		case ILogical::Type::Enum::tString:
+			return parameter->physical->type == IPhysical::Type::Enum::tString;
+		case ILogical::Type::Enum::tInteger:
+			return parameter->physical->type == IPhysical::Type::Enum::tInteger;
+		case ILogical::Type::Enum::tBoolean:
+			return parameter->physical->type == IPhysical::Type::Enum::tBoolean;
+		case ILogical::Type::Enum::tArray:
+			return parameter->physical->type == IPhysical::Type::Enum::none;
+		default:
+			return false;
+	}
+}
+
+const DispatchPlan::Function* DispatchPlan::function(const std::string& functionName) const
+{
+	auto functionIterator = _functions.find(functionName);
+	if(functionIterator == _functions.end()) return nullptr;
+	return &functionIterator->second;
+}
+
+}
@@ -0,0 +1,139 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef DISPATCHPLAN_H_
+#define DISPATCHPLAN_H_
+
+#include <homegear-base/BaseLib.h>
+#include "SonosPacket.h"
+
+#include <list>
+#include <mutex>
+
+namespace Sonos
+{
+
+/**
+ * Precomputed mapping from received values to the parameters they are stored in. The result of walking the packets, payloads, associated variables and
+ * channels of a device description is the same for every packet, so it is computed once per device description.
+ */
+class DispatchPlan
+{
+public:
+	class Target
+	{
+	public:
+		BaseLib::DeviceDescription::PParameter parameter;
+		BaseLib::DeviceDescription::ParameterGroup::Type::Enum parameterSetType = BaseLib::DeviceDescription::ParameterGroup::Type::Enum::none;
+
+		/**
+		 * The channels the parameter exists in.
+		 */
+		std::list<uint32_t> channels;
+
+		/**
+		 * True when the received value can be converted without running it through the parameter's casts. See DispatchPlan::canConvertDirectly().
+		 */
+		bool directConversion = false;
+	};
+
+	class Entry
+	{
+	public:
+		/**
+		 * Index into the frames of the function.
+		 */
+		size_t frameIndex = 0;
+
+		/**
+		 * Empty or the field within the metadata document in "key".
+		 */
+		std::string subkey;
+		SonosPacket::MetadataType metadataType = SonosPacket::MetadataType::count;
+		std::vector<Target> targets;
+	};
+
+	class Function
+	{
+	public:
+		/**
+		 * The IDs of all toCentral packets of the function.
+		 */
+		std::vector<std::string> frameIds;
+
+		/**
+		 * The keys point into DispatchPlan::_keys.
+		 */
+		std::unordered_map<std::string_view, std::vector<Entry>> entriesByKey;
+	};
+
+	explicit DispatchPlan(const std::shared_ptr<BaseLib::DeviceDescription::HomegearDevice>& device);
+	virtual ~DispatchPlan() = default;
+
+	/**
+	 * Returns the plan for the device description. Plans are shared by all peers using the same description. Only the peers own the plans, so a
+	 * plan and the parameters it references are released together with the last peer using it.
+	 */
+	static std::shared_ptr<DispatchPlan> get(const std::shared_ptr<BaseLib::DeviceDescription::HomegearDevice>& device);
+
+	/**
+	 * @return The metadata document type for the key or MetadataType::count if the key is no metadata document.
+	 */
+	static SonosPacket::MetadataType metadataTypeFromKey(const std::string& key);
+
+	/**
+	 * Checks if received values for the parameter can be stored without the encode/decode round trip through the packet converter. That's the case
+	 * when the only cast is "rpcBinary" and the logical type equals the physical type (string, integer or boolean) or the parameter is an array filled
+	 * from a browse result.
+	 */
+	static bool canConvertDirectly(const BaseLib::DeviceDescription::PParameter& parameter);
+
+	/**
+	 * @return Returns true when the plan was created for the device description.
+	 */
+	bool isFor(const std::shared_ptr<BaseLib::DeviceDescription::HomegearDevice>& device) const { return device && _device.lock() == device; }
+
+	/**
+	 * @return The plan for the packet function or nullptr when the device description doesn't handle the function.
+	 */
+	const Function* function(const std::string& functionName) const;
+protected:
+	static std::mutex _plansMutex;
+	static std::unordered_map<BaseLib::DeviceDescription::HomegearDevice*, std::weak_ptr<DispatchPlan>> _plans;
+
+	std::weak_ptr<BaseLib::DeviceDescription::HomegearDevice> _device;
+	std::deque<std::string> _keys;
+	std::unordered_map<std::string, Function> _functions;
+};
+
+typedef std::shared_ptr<DispatchPlan> PDispatchPlan;
+
+}
+
+#endif
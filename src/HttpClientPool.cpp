@@ -0,0 +1,136 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "HttpClientPool.h"
+#include "GD.h"
+
+#include <algorithm>
+
+namespace Sonos
+{
+
+HttpClientPool::HttpClientPool(const std::string& hostname, int32_t port, int32_t readTimeout, int64_t idleTimeout, size_t maxIdle)
+{
+	_hostname = hostname;
+	_port = port;
+	_readTimeout = readTimeout;
+	_idleTimeout = idleTimeout;
+	_maxIdle = maxIdle;
+}
+
+std::shared_ptr<BaseLib::HttpClient> HttpClientPool::createClient()
+{
+	std::shared_ptr<BaseLib::HttpClient> client = std::make_shared<BaseLib::HttpClient>(GD::bl, _hostname, _port, true);
+	client->setTimeout(_readTimeout);
+	return client;
+}
+
+std::shared_ptr<BaseLib::HttpClient> HttpClientPool::acquire(bool& reused)
+{
+	reused = false;
+	{
+		std::lock_guard<std::mutex> connectionsGuard(_connectionsMutex);
+		int64_t time = BaseLib::HelperFunctions::getTime();
+		while(!_idleConnections.empty())
+		{
+			Connection connection = _idleConnections.back();
+			_idleConnections.pop_back();
+			//The speaker closes idle connections itself at some point, so don't try to reuse old ones.
+			if(time - connection.lastUsed > _idleTimeout) continue;
+			reused = true;
+			return connection.client;
+		}
+	}
+	return createClient();
+}
+
+void HttpClientPool::release(std::shared_ptr<BaseLib::HttpClient>& client)
+{
+	std::lock_guard<std::mutex> connectionsGuard(_connectionsMutex);
+	if(_idleConnections.size() >= _maxIdle) return;
+	Connection connection;
+	connection.client = client;
+	connection.lastUsed = BaseLib::HelperFunctions::getTime();
+	_idleConnections.push_back(connection);
+}
+
+void HttpClientPool::sendRequest(const std::string& request, BaseLib::Http& response, bool responseIsHeaderOnly)
+{
+	bool reused = false;
+	std::shared_ptr<BaseLib::HttpClient> client = acquire(reused);
+	std::string requestCopy = request;
+	int64_t startTime = BaseLib::HelperFunctions::getTime();
+	try
+	{
+		client->sendRequest(requestCopy, response, responseIsHeaderOnly);
+	}
+	catch(const BaseLib::HttpClientException& ex)
+	{
+		//Only retry when a reused connection failed right away without any response data, i. e. writing failed or the speaker had already closed
+		//the connection. Read timeouts and other late errors aren't retried, as the speaker might have executed the request already.
+		if(!reused || ex.responseCode() != -1 || !response.getRawHeader().empty() || response.getContentSize() > 0) throw;
+		if(BaseLib::HelperFunctions::getTime() - startTime >= std::min(_readTimeout / 2, 1000)) throw;
+		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Pooled connection to " + _hostname + " is broken (" + ex.what() + "). Reconnecting.");
+		clear();
+		response.reset();
+		client = createClient();
+		requestCopy = request;
+		client->sendRequest(requestCopy, response, responseIsHeaderOnly);
+	}
+	release(client);
+}
+
+void HttpClientPool::clear()
+{
+	try
+	{
+		std::lock_guard<std::mutex> connectionsGuard(_connectionsMutex);
+		_idleConnections.clear();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+size_t HttpClientPool::idleCount()
+{
+	try
+	{
+		std::lock_guard<std::mutex> connectionsGuard(_connectionsMutex);
+		return _idleConnections.size();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return 0;
+}
+
+}
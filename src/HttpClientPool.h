@@ -0,0 +1,105 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef HTTPCLIENTPOOL_H_
+#define HTTPCLIENTPOOL_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Sonos
+{
+
+/**
+ * Keeps persistent HTTP connections to one speaker, so SOAP and GENA requests don't need a new TCP connection each. Idle connections are closed
+ * after a timeout. When a reused connection turns out to be closed by the speaker before any response data is received, the request is repeated
+ * once on a new connection.
+ */
+class HttpClientPool
+{
+public:
+	/**
+	 * @param hostname The IP address or hostname of the speaker.
+	 * @param port The port of the speaker's HTTP server.
+	 * @param readTimeout The time in milliseconds to wait for a response.
+	 * @param idleTimeout The time in milliseconds after which unused connections are closed.
+	 * @param maxIdle The maximum number of connections kept open. Additional concurrent requests use temporary connections.
+	 */
+	HttpClientPool(const std::string& hostname, int32_t port, int32_t readTimeout, int64_t idleTimeout, size_t maxIdle);
+	virtual ~HttpClientPool() = default;
+
+	/**
+	 * Sends a request over a pooled connection. Throws the same exceptions as BaseLib::HttpClient::sendRequest().
+	 */
+	void sendRequest(const std::string& request, BaseLib::Http& response, bool responseIsHeaderOnly = false);
+
+	/**
+	 * Closes all idle connections.
+	 */
+	void clear();
+
+	/**
+	 * @return Returns the number of open idle connections.
+	 */
+	size_t idleCount();
+protected:
+	struct Connection
+	{
+		std::shared_ptr<BaseLib::HttpClient> client;
+
+		/**
+		 * Time in milliseconds since epoch.
+		 */
+		int64_t lastUsed = 0;
+	};
+
+	std::string _hostname;
+	int32_t _port = 1400;
+	int32_t _readTimeout = 10000;
+	int64_t _idleTimeout = 20000;
+	size_t _maxIdle = 2;
+	std::mutex _connectionsMutex;
+	std::vector<Connection> _idleConnections;
+
+	/**
+	 * Returns the most recently used idle connection or a new one.
+	 *
+	 * @param[out] reused Set to true when an existing connection is returned.
+	 */
+	std::shared_ptr<BaseLib::HttpClient> acquire(bool& reused);
+	void release(std::shared_ptr<BaseLib::HttpClient>& client);
+	std::shared_ptr<BaseLib::HttpClient> createClient();
+};
+
+}
+
+#endif
@@ -0,0 +1,180 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "ParameterWriteBuffer.h"
+#include "GD.h"
+
+namespace Sonos
+{
+
+ParameterWriteBuffer::ParameterWriteBuffer(Writer writer) : _writer(std::move(writer))
+{
+	_enabled = false;
+	_stopThread = true;
+}
+
+ParameterWriteBuffer::~ParameterWriteBuffer()
+{
+	stop();
+}
+
+void ParameterWriteBuffer::start()
+{
+	try
+	{
+		stop();
+
+		std::string settingName = "persistenceinterval";
+		BaseLib::Systems::FamilySettings::PFamilySetting setting = GD::family->getFamilySetting(settingName);
+		if(setting) _interval = setting->integerValue;
+		if(_interval < 0) _interval = 0;
+		else if(_interval > 600000) _interval = 600000;
+
+		settingName = "persistencemaxpending";
+		setting = GD::family->getFamilySetting(settingName);
+		if(setting && setting->integerValue > 0) _maxPending = setting->integerValue;
+
+		if(_interval == 0) return; //Write directly
+
+		_stopThread = false;
+		_enabled = true;
+		GD::bl->threadManager.start(_thread, true, &ParameterWriteBuffer::flushThread, this);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void ParameterWriteBuffer::stop()
+{
+	try
+	{
+		_enabled = false;
+		{
+			std::lock_guard<std::mutex> bufferGuard(_bufferMutex);
+			_stopThread = true;
+		}
+		_bufferConditionVariable.notify_all();
+		GD::bl->threadManager.join(_thread);
+		flush();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void ParameterWriteBuffer::set(uint64_t peerId, uint32_t channel, const std::string& key, const std::vector<uint8_t>& data)
+{
+	try
+	{
+		bool flushNow = false;
+		{
+			std::lock_guard<std::mutex> bufferGuard(_bufferMutex);
+			_buffer[Key(peerId, channel, key)] = data;
+			flushNow = _buffer.size() >= _maxPending;
+		}
+		if(flushNow) _bufferConditionVariable.notify_one();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void ParameterWriteBuffer::removePeer(uint64_t peerId)
+{
+	try
+	{
+		//Wait for a running flush, so nothing of the peer is written after this method returns.
+		std::lock_guard<std::mutex> flushGuard(_flushMutex);
+		std::lock_guard<std::mutex> bufferGuard(_bufferMutex);
+		auto begin = _buffer.lower_bound(Key(peerId, 0, ""));
+		auto end = begin;
+		while(end != _buffer.end() && std::get<0>(end->first) == peerId) ++end;
+		_buffer.erase(begin, end);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+size_t ParameterWriteBuffer::size()
+{
+	std::lock_guard<std::mutex> bufferGuard(_bufferMutex);
+	return _buffer.size();
+}
+
+void ParameterWriteBuffer::flush()
+{
+	try
+	{
+		std::lock_guard<std::mutex> flushGuard(_flushMutex);
+		std::map<Key, std::vector<uint8_t>> buffer;
+		{
+			std::lock_guard<std::mutex> bufferGuard(_bufferMutex);
+			buffer.swap(_buffer);
+		}
+		if(buffer.empty()) return;
+
+		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Writing " + std::to_string(buffer.size()) + " buffered variables to the database.");
+		for(auto& element : buffer)
+		{
+			_writer(std::get<0>(element.first), std::get<1>(element.first), std::get<2>(element.first), element.second);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void ParameterWriteBuffer::flushThread()
+{
+	try
+	{
+		while(!_stopThread)
+		{
+			{
+				std::unique_lock<std::mutex> bufferLock(_bufferMutex);
+				_bufferConditionVariable.wait_for(bufferLock, std::chrono::milliseconds(_interval), [&] { return _stopThread || _buffer.size() >= _maxPending; });
+				if(_stopThread) return;
+			}
+			flush();
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+}
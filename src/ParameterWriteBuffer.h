@@ -0,0 +1,107 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef PARAMETERWRITEBUFFER_H_
+#define PARAMETERWRITEBUFFER_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+namespace Sonos
+{
+
+/**
+ * Write-behind buffer for peer variables. Only the latest value of each (peer, channel, key) is kept. The buffer is written to the database in
+ * intervals, when it gets too large and when it is flushed explicitly.
+ */
+class ParameterWriteBuffer
+{
+public:
+	/**
+	 * Called for every buffered value during a flush.
+	 */
+	typedef std::function<void(uint64_t peerId, uint32_t channel, const std::string& key, std::vector<uint8_t>& data)> Writer;
+
+	explicit ParameterWriteBuffer(Writer writer);
+	virtual ~ParameterWriteBuffer();
+
+	/**
+	 * Reads the settings and starts the flush thread.
+	 */
+	void start();
+
+	/**
+	 * Stops the flush thread and writes all buffered values.
+	 */
+	void stop();
+
+	/**
+	 * @return Returns false when buffering is disabled or the buffer is stopped. Values need to be written directly then.
+	 */
+	bool enabled() { return _enabled; }
+
+	void set(uint64_t peerId, uint32_t channel, const std::string& key, const std::vector<uint8_t>& data);
+
+	/**
+	 * Discards all buffered values of a peer, e. g. when it is deleted.
+	 */
+	void removePeer(uint64_t peerId);
+
+	void flush();
+	size_t size();
+protected:
+	typedef std::tuple<uint64_t, uint32_t, std::string> Key;
+
+	Writer _writer;
+	std::atomic_bool _enabled;
+	std::atomic_bool _stopThread;
+	int32_t _interval = 10000;
+	size_t _maxPending = 1000;
+	std::thread _thread;
+	std::mutex _bufferMutex;
+	std::condition_variable _bufferConditionVariable;
+	std::map<Key, std::vector<uint8_t>> _buffer;
+
+	/**
+	 * Makes sure flushes don't overtake each other, so an older value is never written after a newer one.
+	 */
+	std::mutex _flushMutex;
+
+	void flushThread();
+};
+
+}
+
+#endif
@@ -32,6 +32,8 @@
 #include "homegear-base/Encoding/RapidXml/rapidxml.h"
 #include <ifaddrs.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 namespace Sonos {
 EventServer::EventServer(std::shared_ptr<BaseLib::Systems::PhysicalInterfaceSettings> settings) : ISonosInterface(settings) {
@@ -39,6 +41,7 @@ EventServer::EventServer(std::shared_ptr<BaseLib::Systems::PhysicalInterfaceSett
   _out.setPrefix(GD::out.getPrefix() + "Event server \"" + settings->id + "\": ");
 
   _stopServer = true;
+  _stopWorkers = true;
 
   if (!settings) {
     _out.printCritical("Critical: Error initializing. Settings pointer is empty.");
@@ -47,14 +50,20 @@ EventServer::EventServer(std::shared_ptr<BaseLib::Systems::PhysicalInterfaceSett
   _listenPort = BaseLib::Math::getNumber(settings->port);
   if (_listenPort <= 0 || _listenPort > 65535) _listenPort = 7373;
 
-  std::string httpOkHeader("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n");
+  std::string httpOkHeader("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
   _httpOkHeader.insert(_httpOkHeader.end(), httpOkHeader.begin(), httpOkHeader.end());
 }
 
 EventServer::~EventServer() {
   try {
     _stopServer = true;
+    wakeUp();
     GD::bl->threadManager.join(_listenThread);
+    stopWorkers();
+    if (_wakeUpFileDescriptor != -1) {
+      close(_wakeUpFileDescriptor);
+      _wakeUpFileDescriptor = -1;
+    }
   }
   catch (const std::exception &ex) {
     _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -76,6 +85,70 @@ void EventServer::setListenAddress() {
   }
 }
 
+void EventServer::readSettings() {
+  try {
+    std::string settingName = "eventworkerthreads";
+    BaseLib::Systems::FamilySettings::PFamilySetting setting = GD::family->getFamilySetting(settingName);
+    if (setting) _workerCount = setting->integerValue;
+    if (_workerCount < 1) _workerCount = 1;
+    else if (_workerCount > 32) _workerCount = 32;
+
+    settingName = "eventqueuesize";
+    setting = GD::family->getFamilySetting(settingName);
+    if (setting && setting->integerValue > 0) _queueSize = setting->integerValue;
+    if (_queueSize < 10) _queueSize = 10;
+    else if (_queueSize > 100000) _queueSize = 100000;
+
+    settingName = "eventoverloadpolicy";
+    setting = GD::family->getFamilySetting(settingName);
+    _overloadPolicy = OverloadPolicy::dropOldest;
+    if (setting) {
+      std::string policy = BaseLib::HelperFunctions::toLower(setting->stringValue);
+      if (policy == "reject") _overloadPolicy = OverloadPolicy::reject;
+      else if (policy.empty() || policy == "dropoldest") _overloadPolicy = OverloadPolicy::dropOldest;
+      else _out.printWarning("Warning: Unknown value for \"eventOverloadPolicy\": " + setting->stringValue + ". Using \"dropOldest\".");
+    }
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::startWorkers() {
+  try {
+    stopWorkers();
+    _stopWorkers = false;
+    _workers.reserve(_workerCount);
+    for (int32_t i = 0; i < _workerCount; i++) {
+      _workers.emplace_back(new NotifyWorker());
+    }
+    for (int32_t i = 0; i < _workerCount; i++) {
+      _bl->threadManager.start(_workers.at(i)->thread, true, &EventServer::notifyWorker, this, i);
+    }
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::stopWorkers() {
+  try {
+    //The queued events were already acknowledged and won't be sent again, so the workers process them before exiting.
+    for (auto &worker : _workers) {
+      {
+        std::lock_guard<std::mutex> queueGuard(worker->queueMutex);
+        _stopWorkers = true;
+      }
+      worker->queueConditionVariable.notify_all();
+      _bl->threadManager.join(worker->thread);
+    }
+    _workers.clear();
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
 void EventServer::startListening() {
   try {
     stopListening();
@@ -86,6 +159,15 @@ void EventServer::startListening() {
     }
     _ipAddress = _listenAddress;
     _hostname = _listenAddress;
+    if (_wakeUpFileDescriptor == -1) {
+      _wakeUpFileDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (_wakeUpFileDescriptor == -1) {
+        _out.printCritical("Critical: Could not create wake up file descriptor: " + std::string(strerror(errno)));
+        return;
+      }
+    }
+    readSettings();
+    startWorkers();
     _stopServer = false;
     _bl->threadManager.start(_listenThread, true, _settings->listenThreadPriority, _settings->listenThreadPolicy, &EventServer::mainThread, this);
     IPhysicalInterface::startListening();
@@ -99,7 +181,9 @@ void EventServer::stopListening() {
   try {
     if (_stopServer) return;
     _stopServer = true;
+    wakeUp();
     GD::bl->threadManager.join(_listenThread);
+    stopWorkers();
 
     IPhysicalInterface::stopListening();
   }
@@ -108,87 +192,229 @@ void EventServer::stopListening() {
   }
 }
 
+void EventServer::wakeUp() {
+  if (_wakeUpFileDescriptor == -1) return;
+  uint64_t value = 1;
+  if (write(_wakeUpFileDescriptor, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN) {
+    _out.printError("Error: Could not wake up event server thread: " + std::string(strerror(errno)));
+  }
+}
+
 void EventServer::mainThread() {
   try {
-    getSocketDescriptor();
+    _epollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFileDescriptor == -1) {
+      _out.printCritical("Critical: Could not create epoll file descriptor: " + std::string(strerror(errno)));
+      return;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = _wakeUpFileDescriptor;
+    if (epoll_ctl(_epollFileDescriptor, EPOLL_CTL_ADD, _wakeUpFileDescriptor, &event) == -1) {
+      _out.printCritical("Critical: Could not add wake up file descriptor to epoll: " + std::string(strerror(errno)));
+      close(_epollFileDescriptor);
+      _epollFileDescriptor = -1;
+      return;
+    }
 
-    std::string ipAddress;
-    int32_t port = -1;
-    C1Net::PSocket clientFileDescriptor;
+    const int32_t maxEvents = 64;
+    epoll_event events[maxEvents];
+    int64_t lastTimeoutCheck = BaseLib::HelperFunctions::getTime();
 
     while (!_stopServer) {
       try {
         if (!_serverFileDescriptor || !_serverFileDescriptor->IsValid()) {
-          if (_stopServer) break;
-          std::this_thread::sleep_for(std::chrono::milliseconds(5000));
           getSocketDescriptor();
+          if (_serverFileDescriptor && _serverFileDescriptor->IsValid()) {
+            event = epoll_event{};
+            event.events = EPOLLIN;
+            event.data.fd = _serverFileDescriptor->GetHandle();
+            if (epoll_ctl(_epollFileDescriptor, EPOLL_CTL_ADD, _serverFileDescriptor->GetHandle(), &event) == -1) {
+              _out.printError("Error: Could not add server socket to epoll: " + std::string(strerror(errno)));
+              _serverFileDescriptor->Shutdown();
+            }
+          }
+        }
+
+        //Retry binding after 5 seconds. The wake up file descriptor still stops the loop immediately.
+        int32_t timeout = (_serverFileDescriptor && _serverFileDescriptor->IsValid()) ? 1000 : 5000;
+        int32_t eventCount = epoll_wait(_epollFileDescriptor, events, maxEvents, timeout);
+        if (eventCount == -1) {
+          if (errno == EINTR) continue;
+          _out.printError("Error: epoll_wait failed: " + std::string(strerror(errno)));
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
           continue;
         }
-        clientFileDescriptor = getClientSocketDescriptor(ipAddress, port);
-        if (!clientFileDescriptor || !clientFileDescriptor->IsValid()) continue;
 
-        C1Net::TcpSocketInfo tcp_socket_info;
+        for (int32_t i = 0; i < eventCount; i++) {
+          int32_t fileDescriptor = events[i].data.fd;
+          if (fileDescriptor == _wakeUpFileDescriptor) {
+            uint64_t value = 0;
+            while (read(_wakeUpFileDescriptor, &value, sizeof(value)) > 0);
+            continue;
+          }
+          if (_serverFileDescriptor && fileDescriptor == _serverFileDescriptor->GetHandle()) {
+            acceptClients();
+            continue;
+          }
+
+          auto clientIterator = _clients.find(fileDescriptor);
+          if (clientIterator == _clients.end()) continue;
+          PClientData client = clientIterator->second;
+          if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readClient(client);
+          if ((events[i].events & EPOLLOUT) && _clients.find(fileDescriptor) != _clients.end()) writeClient(client);
+        }
 
-        auto socket = std::make_shared<C1Net::TcpSocket>(tcp_socket_info, clientFileDescriptor);
-        readClient(socket, ipAddress, port);
+        if (BaseLib::HelperFunctions::getTime() - lastTimeoutCheck >= 1000) {
+          lastTimeoutCheck = BaseLib::HelperFunctions::getTime();
+          closeTimedOutClients();
+        }
       }
       catch (const std::exception &ex) {
         _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
       }
-      clientFileDescriptor->Shutdown();
     }
   }
   catch (const std::exception &ex) {
     _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
   }
+
+  for (auto &client : _clients) {
+    client.second->socket->Shutdown();
+  }
+  _clients.clear();
   if (_serverFileDescriptor) _serverFileDescriptor->Shutdown();
+  if (_epollFileDescriptor != -1) {
+    close(_epollFileDescriptor);
+    _epollFileDescriptor = -1;
+  }
 }
 
-void EventServer::readClient(C1Net::PTcpSocket socket, const std::string &ipAddress, int32_t port) {
+void EventServer::acceptClients() {
   try {
-    if (!socket) return;
-    int32_t bufferMax = 1024;
-    char buffer[bufferMax + 1];
-    //Make sure the buffer is null terminated.
-    buffer[bufferMax] = '\0';
-    std::vector<char> packet;
-    int32_t bytesRead;
-    bool more_data = false;
-    BaseLib::Http http;
-
     while (!_stopServer) {
-      try {
-        bytesRead = socket->Read((uint8_t *)buffer, bufferMax, more_data);
-        buffer[bufferMax] = 0; //Even though it shouldn't matter, make sure there is a null termination.
-        //Some clients send only one byte in the first packet
-        if (!http.headerProcessingStarted() && bytesRead == 1) bytesRead += socket->Read((uint8_t *)buffer + 1, bufferMax - 1, more_data);
+      struct sockaddr_storage clientInfo{};
+      socklen_t addressSize = sizeof(clientInfo);
+      int32_t fileDescriptor = accept4(_serverFileDescriptor->GetHandle(), (struct sockaddr *)&clientInfo, &addressSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fileDescriptor == -1) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) _out.printError("Error: Could not accept client: " + std::string(strerror(errno)));
+        return;
+      }
+
+      auto client = std::make_shared<ClientData>();
+      client->socket = std::make_shared<C1Net::Socket>(fileDescriptor);
+      client->lastActivity = BaseLib::HelperFunctions::getTime();
+
+      if ((signed)_clients.size() >= _maxClients) {
+        _out.printError("Error: Too many concurrent connections. Rejecting client.");
+        client->socket->Shutdown();
+        continue;
       }
-      catch (const C1Net::TimeoutException &ex) {
-        _out.printWarning("Warning: Connection timed out.");
-        break;
+
+      char ipString[INET6_ADDRSTRLEN];
+      if (clientInfo.ss_family == AF_INET) {
+        auto *s = (struct sockaddr_in *)&clientInfo;
+        client->port = ntohs(s->sin_port);
+        inet_ntop(AF_INET, &s->sin_addr, ipString, sizeof(ipString));
+      } else { // AF_INET6
+        auto *s = (struct sockaddr_in6 *)&clientInfo;
+        client->port = ntohs(s->sin6_port);
+        inet_ntop(AF_INET6, &s->sin6_addr, ipString, sizeof(ipString));
       }
-      catch (const C1Net::ClosedException &ex) {
-        _out.printInfo("Info: " + std::string(ex.what()));
-        break;
+      client->ipAddress = std::string(&ipString[0]);
+
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLRDHUP;
+      event.data.fd = fileDescriptor;
+      if (epoll_ctl(_epollFileDescriptor, EPOLL_CTL_ADD, fileDescriptor, &event) == -1) {
+        _out.printError("Error: Could not add client socket to epoll: " + std::string(strerror(errno)));
+        client->socket->Shutdown();
+        continue;
       }
-      catch (const C1Net::Exception &ex) {
-        _out.printError(ex.what());
-        break;
+      _clients.emplace(fileDescriptor, client);
+      if (GD::bl->debugLevel >= 5) _out.printDebug("Debug: Connection from " + client->ipAddress + ":" + std::to_string(client->port) + " accepted. Client number: " + std::to_string(fileDescriptor));
+    }
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::closeClient(const PClientData &client) {
+  try {
+    if (!client || !client->socket) return;
+    int32_t fileDescriptor = client->socket->GetHandle();
+    if (fileDescriptor != -1) epoll_ctl(_epollFileDescriptor, EPOLL_CTL_DEL, fileDescriptor, nullptr);
+    _clients.erase(fileDescriptor);
+    client->socket->Shutdown();
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::closeTimedOutClients() {
+  try {
+    int64_t time = BaseLib::HelperFunctions::getTime();
+    std::vector<PClientData> timedOutClients;
+    for (auto &client : _clients) {
+      if (time - client.second->lastActivity > _clientTimeout) timedOutClients.push_back(client.second);
+    }
+    for (auto &client : timedOutClients) {
+      if (!client->finished) _out.printWarning("Warning: Connection to " + client->ipAddress + ":" + std::to_string(client->port) + " timed out.");
+      closeClient(client);
+    }
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::readClient(const PClientData &client) {
+  try {
+    const int32_t bufferMax = 4096;
+    char buffer[bufferMax + 1];
+    BaseLib::Http &http = client->http;
+
+    while (!_stopServer) {
+      ssize_t bytesRead = recv(client->socket->GetHandle(), buffer, bufferMax, 0);
+      if (bytesRead == 0) {
+        if (!client->finished) _out.printInfo("Info: Connection to " + client->ipAddress + ":" + std::to_string(client->port) + " closed by client.");
+        closeClient(client);
+        return;
+      } else if (bytesRead == -1) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        _out.printError("Error reading from " + client->ipAddress + ":" + std::to_string(client->port) + ": " + std::string(strerror(errno)));
+        closeClient(client);
+        return;
       }
+      client->lastActivity = BaseLib::HelperFunctions::getTime();
+      if (client->finished || !client->sendBuffer.empty()) continue; //Ignore everything after the request.
 
       if (GD::bl->debugLevel >= 5) {
         std::vector<uint8_t> rawPacket(buffer, buffer + bytesRead);
         _out.printDebug("Debug: Packet received: " + BaseLib::HelperFunctions::getHexString(rawPacket));
       }
       buffer[bytesRead] = '\0';
-      if (!http.headerProcessingStarted() && (!strncmp(buffer, "NOTIFY", 6) || !strncmp(buffer, "GET", 3) || !strncmp(buffer, "HTTP/1.", 7))) http.reset();
-      else if (!http.headerProcessingStarted()) {
-        _out.printError("Error: Uninterpretable packet received. Closing connection. Packet was: " + std::string(buffer, bytesRead));
-        break;
-      }
 
       try {
-        http.process(buffer, bytesRead);
+        if (!http.headerProcessingStarted()) {
+          //Some clients send only one byte in the first packet, so wait until we can check the method.
+          client->requestStart.append(buffer, bytesRead);
+          if (client->requestStart.size() < 7) continue;
+          if (client->requestStart.compare(0, 6, "NOTIFY") == 0 || client->requestStart.compare(0, 3, "GET") == 0 || client->requestStart.compare(0, 7, "HTTP/1.") == 0) http.reset();
+          else {
+            _out.printError("Error: Uninterpretable packet received. Closing connection. Packet was: " + client->requestStart);
+            closeClient(client);
+            return;
+          }
+          std::string requestStart;
+          requestStart.swap(client->requestStart);
+          http.process(&requestStart.at(0), requestStart.size());
+        } else http.process(buffer, bytesRead);
       }
       catch (BaseLib::HttpException &ex) {
         _out.printError("Error: Could not process HTTP packet: " + std::string(ex.what()) + " Buffer: " + std::string(buffer, bytesRead));
@@ -201,63 +427,212 @@ void EventServer::readClient(C1Net::PTcpSocket socket, const std::string &ipAddr
       }
 
       if (http.isFinished()) {
+        processRequest(client);
+        return;
+      }
+    }
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
 
-        //std::cerr << std::string(&http.getContent()->at(0)) << std::endl;
+void EventServer::writeClient(const PClientData &client) {
+  try {
+    while (client->sendOffset < client->sendBuffer.size()) {
+      ssize_t bytesSent = send(client->socket->GetHandle(), client->sendBuffer.data() + client->sendOffset, client->sendBuffer.size() - client->sendOffset, MSG_NOSIGNAL);
+      if (bytesSent == -1) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          epoll_event event{};
+          event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+          event.data.fd = client->socket->GetHandle();
+          epoll_ctl(_epollFileDescriptor, EPOLL_CTL_MOD, client->socket->GetHandle(), &event);
+          return;
+        }
+        _out.printInfo("Info: Could not send response to " + client->ipAddress + ":" + std::to_string(client->port) + ": " + std::string(strerror(errno)));
+        closeClient(client);
+        return;
+      }
+      client->sendOffset += bytesSent;
+      client->lastActivity = BaseLib::HelperFunctions::getTime();
+    }
 
-        std::vector<char> response;
-        if (http.getHeader().method == "GET") {
-          http.getHeader().remoteAddress = ipAddress;
-          http.getHeader().remotePort = port;
-          httpGet(http, response);
-          if (GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Webserver response: " + BaseLib::HelperFunctions::getHexString(response));
+    //Response is sent completely. Shut down the write side, so the client sees the end of the response before we close the connection.
+    client->sendBuffer.clear();
+    client->sendOffset = 0;
+    client->finished = true;
+    shutdown(client->socket->GetHandle(), SHUT_WR);
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = client->socket->GetHandle();
+    epoll_ctl(_epollFileDescriptor, EPOLL_CTL_MOD, client->socket->GetHandle(), &event);
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
 
-          try {
-            std::this_thread::sleep_for(std::chrono::milliseconds(22)); //Wait a little. Otherwise clients might not receive response.
-            socket->Send((uint8_t *)response.data(), response.size());
-          }
-          catch (const C1Net::Exception &ex) {
-            _out.printInfo("Info: " + std::string(ex.what()));
-          }
-          break;
-        } else {
-          BaseLib::Http::Header &header = http.getHeader();
-          std::string serialNumber;
-          if (header.fields.find("sid") != header.fields.end()) {
-            serialNumber = header.fields.at("sid");
-            if (serialNumber.size() > 24) serialNumber = serialNumber.substr(12, 12); else serialNumber.clear();
-          }
-          if (http.getContentSize() > 0 && !serialNumber.empty()) {
-            xml_document doc;
-            doc.parse<parse_no_entity_translation>((char *)http.getContent().data()); //Dirty, but data is not modified
-            for (xml_node *node = doc.first_node(); node; node = node->next_sibling()) {
-              std::string name(node->name());
-              if (name == "e:propertyset") {
-                for (xml_node *subNode = node->first_node(); subNode; subNode = subNode->next_sibling()) {
-                  std::string subNodeName(subNode->name());
-                  if (subNodeName == "e:property") {
-                    if (subNode->first_node() && std::string(subNode->first_node()->name()) == "LastChange") {
-                      std::string xml;
-                      for (xml_node *propertyNode = subNode->first_node(); propertyNode; propertyNode = propertyNode->next_sibling()) {
-                        std::string propertyName(propertyNode->name());
-                        std::string value(propertyNode->value());
-                        BaseLib::Html::unescapeHtmlEntities(value, xml);
-                        std::shared_ptr<SonosPacket> packet(new SonosPacket(xml, serialNumber, BaseLib::HelperFunctions::getTime()));
-                        raisePacketReceived(packet);
-                      }
-                    } else {
-                      std::shared_ptr<SonosPacket> packet(new SonosPacket(subNode, serialNumber, BaseLib::HelperFunctions::getTime()));
-                      raisePacketReceived(packet);
-                    }
-                  } else _out.printWarning("Unknown element in \"e:propertyset\": " + name);
-                }
-              } else _out.printWarning("Unknown root element: " + name);
-            }
-            _lastPacketReceived = BaseLib::HelperFunctions::getTime();
-            socket->Send((uint8_t *)_httpOkHeader.data(), _httpOkHeader.size());
-          } else _out.printWarning("Warning: Packet without content or serial number received.");
-          break;
+void EventServer::processRequest(const PClientData &client) {
+  try {
+    BaseLib::Http &http = client->http;
+    std::vector<char> response;
+    if (http.getHeader().method == "GET") {
+      http.getHeader().remoteAddress = client->ipAddress;
+      http.getHeader().remotePort = client->port;
+      httpGet(http, response);
+      if (GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Webserver response: " + BaseLib::HelperFunctions::getHexString(response));
+    } else processNotify(http, response);
+
+    if (response.empty()) {
+      closeClient(client);
+      return;
+    }
+    client->sendBuffer.swap(response);
+    client->sendOffset = 0;
+    http.reset();
+    writeClient(client);
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::registerSubscription(const std::string &sid, const std::string &serialNumber, uint64_t peerId, const std::string &service) {
+  try {
+    std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+    SubscriptionInfo &subscription = _subscriptions[sid];
+    subscription.serialNumber = serialNumber;
+    subscription.peerId = peerId;
+    subscription.service = service;
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EventServer::unregisterSubscription(const std::string &sid) {
+  try {
+    std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+    _subscriptions.erase(sid);
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+std::map<std::string, ISonosInterface::EventStatistics> EventServer::eventStatistics() {
+  std::map<std::string, EventStatistics> statistics;
+  try {
+    std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+    for (auto &element : _eventStatistics) {
+      statistics[element.first] = element.second;
+    }
+    for (auto &subscription : _subscriptions) {
+      statistics[subscription.second.service].subscriptions++;
+    }
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return statistics;
+}
+
+void EventServer::processNotify(BaseLib::Http &http, std::vector<char> &response) {
+  try {
+    BaseLib::Http::Header &header = http.getHeader();
+    auto notifyData = std::make_shared<NotifyData>();
+    auto sidIterator = header.fields.find("sid");
+    if (sidIterator != header.fields.end()) {
+      notifyData->sid = sidIterator->second;
+      BaseLib::HelperFunctions::trim(notifyData->sid);
+      std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+      auto subscriptionIterator = _subscriptions.find(notifyData->sid);
+      if (subscriptionIterator != _subscriptions.end()) {
+        notifyData->serialNumber = subscriptionIterator->second.serialNumber;
+        notifyData->peerId = subscriptionIterator->second.peerId;
+        notifyData->service = subscriptionIterator->second.service;
+      }
+      EventStatistics &statistics = _eventStatistics[notifyData->service.empty() ? "unknown" : notifyData->service];
+      statistics.events++;
+      statistics.bytes += http.getContentSize();
+    }
+    if (notifyData->serialNumber.empty()) {
+      //The initial event (SEQ 0) can arrive before the response to SUBSCRIBE was processed. Take the serial number from the SID then ("uuid:RINCON_<serial number>...").
+      auto seqIterator = header.fields.find("seq");
+      if (seqIterator != header.fields.end() && BaseLib::HelperFunctions::trim(seqIterator->second) == "0") {
+        if (notifyData->sid.size() > 24) notifyData->serialNumber = notifyData->sid.substr(12, 12);
+      } else {
+        //Unknown or stale subscription (e. g. from before a restart). "412" makes the speaker cancel it.
+        if (GD::bl->debugLevel >= 5) _out.printDebug("Debug: Rejecting event for unknown subscription " + notifyData->sid + ".");
+        getHttpError(412, "Precondition Failed", "Unknown subscription.", response);
+        return;
+      }
+    }
+    if (http.getContentSize() > 0 && !notifyData->serialNumber.empty()) {
+      notifyData->content = std::make_shared<std::vector<char>>();
+      notifyData->content->reserve(http.getContentSize() + 1);
+      notifyData->content->insert(notifyData->content->end(), http.getContent().begin(), http.getContent().begin() + http.getContentSize());
+      notifyData->content->push_back('\0');
+      notifyData->time = BaseLib::HelperFunctions::getTime();
+      if (enqueueNotify(notifyData)) response = _httpOkHeader;
+      else {
+        std::vector<std::string> additionalHeaders{"Retry-After: 1"};
+        getHttpError(503, "Service Unavailable", "Too many events are queued for processing.", response, additionalHeaders);
+      }
+    } else _out.printWarning("Warning: Packet without content or serial number received.");
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool EventServer::enqueueNotify(const PNotifyData &notifyData) {
+  try {
+    if (_workers.empty()) return false;
+    auto &worker = _workers.at(std::hash<std::string>()(notifyData->serialNumber) % _workers.size());
+    {
+      std::lock_guard<std::mutex> queueGuard(worker->queueMutex);
+      if (worker->queue.size() >= _queueSize) {
+        if (_overloadPolicy == OverloadPolicy::reject) {
+          _out.printWarning("Warning: Event queue is full. Rejecting event of " + notifyData->serialNumber + ".");
+          return false;
+        }
+
+        //Drop the oldest event of the same subscription. Events of other subscriptions are never dropped, as LastChange events
+        //only contain the changes since the previous event. When there is no event of the same subscription, reject this one.
+        auto dropIterator = std::find_if(worker->queue.begin(), worker->queue.end(), [&](const PNotifyData &element) { return element->sid == notifyData->sid; });
+        if (dropIterator == worker->queue.end()) {
+          _out.printWarning("Warning: Event queue is full and contains no event of the same subscription. Rejecting event of " + notifyData->serialNumber + ".");
+          return false;
         }
+        _out.printWarning("Warning: Event queue is full. Dropping oldest event of " + (*dropIterator)->serialNumber + ".");
+        worker->queue.erase(dropIterator);
+      }
+      worker->queue.push_back(notifyData);
+    }
+    worker->queueConditionVariable.notify_one();
+    return true;
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+void EventServer::notifyWorker(int32_t index) {
+  try {
+    NotifyWorker &worker = *_workers.at(index);
+    while (true) {
+      PNotifyData notifyData;
+      {
+        std::unique_lock<std::mutex> queueGuard(worker.queueMutex);
+        worker.queueConditionVariable.wait(queueGuard, [&] { return !worker.queue.empty() || _stopWorkers; });
+        if (worker.queue.empty()) return;
+        notifyData = std::move(worker.queue.front());
+        worker.queue.pop_front();
       }
+      processNotifyData(notifyData);
     }
   }
   catch (const std::exception &ex) {
@@ -265,6 +640,42 @@ void EventServer::readClient(C1Net::PTcpSocket socket, const std::string &ipAddr
   }
 }
 
+void EventServer::processNotifyData(const PNotifyData &notifyData) {
+  try {
+    const std::string &serialNumber = notifyData->serialNumber;
+    xml_document doc;
+    doc.parse<parse_no_entity_translation>(notifyData->content->data());
+    for (xml_node *node = doc.first_node(); node; node = node->next_sibling()) {
+      std::string name(node->name());
+      if (name == "e:propertyset") {
+        for (xml_node *subNode = node->first_node(); subNode; subNode = subNode->next_sibling()) {
+          std::string subNodeName(subNode->name());
+          if (subNodeName == "e:property") {
+            if (subNode->first_node() && std::string(subNode->first_node()->name()) == "LastChange") {
+              for (xml_node *propertyNode = subNode->first_node(); propertyNode; propertyNode = propertyNode->next_sibling()) {
+                //The escaped document is decoded and parsed in place within the request body.
+                std::shared_ptr<SonosPacket> packet(new SonosPacket(notifyData->content, propertyNode->value(), propertyNode->value_size(), serialNumber, BaseLib::HelperFunctions::getTime()));
+                packet->setPeerId(notifyData->peerId);
+                packet->setService(notifyData->service);
+                raisePacketReceived(packet);
+              }
+            } else {
+              std::shared_ptr<SonosPacket> packet(new SonosPacket(subNode, notifyData->content, serialNumber, BaseLib::HelperFunctions::getTime()));
+              packet->setPeerId(notifyData->peerId);
+              packet->setService(notifyData->service);
+              raisePacketReceived(packet);
+            }
+          } else _out.printWarning("Unknown element in \"e:propertyset\": " + name);
+        }
+      } else _out.printWarning("Unknown root element: " + name);
+    }
+    _lastPacketReceived = BaseLib::HelperFunctions::getTime();
+  }
+  catch (const std::exception &ex) {
+    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
 void EventServer::getSocketDescriptor() {
   try {
     addrinfo hostInfo;
@@ -325,55 +736,6 @@ void EventServer::getSocketDescriptor() {
   }
 }
 
-C1Net::PSocket EventServer::getClientSocketDescriptor(std::string &ipAddress, int32_t &port) {
-  C1Net::PSocket fileDescriptor;
-  try {
-    timeval timeout{};
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    fd_set readFileDescriptor;
-    int32_t nfds = 0;
-    FD_ZERO(&readFileDescriptor);
-    {
-      auto fileDescriptorGuard = GD::bl->fileDescriptorManager.getLock();
-      fileDescriptorGuard.lock();
-      nfds = _serverFileDescriptor->GetHandle() + 1;
-      if (nfds <= 0) {
-        fileDescriptorGuard.unlock();
-        GD::out.printError("Error: Server file descriptor is invalid.");
-        return fileDescriptor;
-      }
-      FD_SET(_serverFileDescriptor->GetHandle(), &readFileDescriptor);
-    }
-    if (!select(nfds, &readFileDescriptor, NULL, NULL, &timeout)) return fileDescriptor;
-
-    struct sockaddr_storage clientInfo{};
-    socklen_t addressSize = sizeof(addressSize);
-    fileDescriptor = std::make_shared<C1Net::Socket>(accept(_serverFileDescriptor->GetHandle(), (struct sockaddr *)&clientInfo, &addressSize));
-    if (!fileDescriptor) return fileDescriptor;
-
-    getpeername(fileDescriptor->GetHandle(), (struct sockaddr *)&clientInfo, &addressSize);
-
-    char ipString[INET6_ADDRSTRLEN];
-    if (clientInfo.ss_family == AF_INET) {
-      auto *s = (struct sockaddr_in *)&clientInfo;
-      port = ntohs(s->sin_port);
-      inet_ntop(AF_INET, &s->sin_addr, ipString, sizeof(ipString));
-    } else { // AF_INET6
-      auto *s = (struct sockaddr_in6 *)&clientInfo;
-      port = ntohs(s->sin6_port);
-      inet_ntop(AF_INET6, &s->sin6_addr, ipString, sizeof(ipString));
-    }
-
-    ipAddress = std::string(&ipString[0]);
-    _out.printInfo("Info: Connection from " + ipAddress + ":" + std::to_string(port) + " accepted. Client number: " + std::to_string(fileDescriptor->GetHandle()));
-  }
-  catch (const std::exception &ex) {
-    _out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-  }
-  return fileDescriptor;
-}
-
 std::string EventServer::getHttpHeader(uint32_t contentLength, std::string contentType, int32_t code, std::string codeDescription, std::vector<std::string> &additionalHeaders) {
   try {
     std::string additionalHeader;
@@ -33,6 +33,11 @@
 #include "../SonosPacket.h"
 #include "ISonosInterface.h"
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
 namespace Sonos {
 
 class EventServer : public ISonosInterface {
@@ -48,20 +53,104 @@ class EventServer : public ISonosInterface {
   int32_t listenPort() { return _listenPort; }
   std::string ttsProgram() { return _settings->ttsProgram; }
   std::string dataPath() { return _settings->dataPath; }
+  void registerSubscription(const std::string &sid, const std::string &serialNumber, uint64_t peerId, const std::string &service);
+  void unregisterSubscription(const std::string &sid);
+  std::map<std::string, EventStatistics> eventStatistics();
  protected:
+  struct SubscriptionInfo {
+    std::string serialNumber;
+    uint64_t peerId = 0;
+    std::string service;
+  };
+
+  struct ClientData {
+    C1Net::PSocket socket;
+    std::string ipAddress;
+    int32_t port = -1;
+    BaseLib::Http http;
+    /**
+     * Holds the first bytes of a request until there are enough to check the method.
+     */
+    std::string requestStart;
+    std::vector<char> sendBuffer;
+    size_t sendOffset = 0;
+    /**
+     * Set after the response has been sent completely. The write side is shut down then and we only wait for the client to close the connection.
+     */
+    bool finished = false;
+    int64_t lastActivity = 0;
+  };
+  typedef std::shared_ptr<ClientData> PClientData;
+
+  struct NotifyData {
+    std::string sid;
+    std::string serialNumber;
+    uint64_t peerId = 0;
+    std::string service;
+    /**
+     * The request body. It is parsed in place and the created packets keep it alive as long as they need it.
+     */
+    std::shared_ptr<std::vector<char>> content;
+    int64_t time = 0;
+  };
+  typedef std::shared_ptr<NotifyData> PNotifyData;
+
+  enum class OverloadPolicy {
+    dropOldest,
+    reject
+  };
+
+  /**
+   * NOTIFY requests are processed by a pool of workers. All requests of one speaker go to the same worker, so its state changes are applied in order.
+   */
+  struct NotifyWorker {
+    std::thread thread;
+    std::mutex queueMutex;
+    std::condition_variable queueConditionVariable;
+    std::deque<PNotifyData> queue;
+  };
+
   std::atomic_bool _stopServer;
   int64_t _lastAction = 0;
   std::string _listenAddress;
   int32_t _listenPort = 7373;
-  int32_t _backLog = 10;
+  int32_t _backLog = 100;
+  int32_t _maxClients = 1000;
+  int32_t _clientTimeout = 10000;
   C1Net::PSocket _serverFileDescriptor;
+  int32_t _epollFileDescriptor = -1;
+  int32_t _wakeUpFileDescriptor = -1;
+  std::unordered_map<int32_t, PClientData> _clients;
   std::vector<char> _httpOkHeader;
+  std::atomic_bool _stopWorkers;
+  int32_t _workerCount = 2;
+  uint32_t _queueSize = 1000;
+  OverloadPolicy _overloadPolicy = OverloadPolicy::dropOldest;
+  std::vector<std::unique_ptr<NotifyWorker>> _workers;
+  std::mutex _subscriptionsMutex;
+  std::unordered_map<std::string, SubscriptionInfo> _subscriptions;
+  /**
+   * Events received per service. Events of unknown subscriptions are counted as "unknown".
+   */
+  std::unordered_map<std::string, EventStatistics> _eventStatistics;
 
   void setListenAddress();
+  void readSettings();
+  void startWorkers();
+  void stopWorkers();
+  void notifyWorker(int32_t index);
+  bool enqueueNotify(const PNotifyData &notifyData);
+  void processNotifyData(const PNotifyData &notifyData);
   void getSocketDescriptor();
-  C1Net::PSocket getClientSocketDescriptor(std::string &ipAddress, int32_t &port);
+  void wakeUp();
   void mainThread();
-  void readClient(C1Net::PTcpSocket socket, const std::string &ipAddress, int32_t port);
+  void acceptClients();
+  void closeClient(const PClientData &client);
+  void closeTimedOutClients();
+  void readClient(const PClientData &client);
+  void writeClient(const PClientData &client);
+  void processRequest(const PClientData &client);
+  void processNotify(BaseLib::Http &http, std::vector<char> &response);
   std::string getHttpHeader(uint32_t contentLength, std::string contentType, int32_t code, std::string codeDescription, std::vector<std::string> &additionalHeaders);
   void getHttpError(int32_t code, std::string codeDescription, std::string longDescription, std::vector<char> &content);
   void getHttpError(int32_t code, std::string codeDescription, std::string longDescription, std::vector<char> &content, std::vector<std::string> &additionalHeaders);
@@ -38,6 +38,13 @@ namespace Sonos {
 class ISonosInterface : public BaseLib::Systems::IPhysicalInterface
 {
 public:
+	struct EventStatistics
+	{
+		uint64_t subscriptions = 0;
+		uint64_t events = 0;
+		uint64_t bytes = 0;
+	};
+
 	ISonosInterface(std::shared_ptr<BaseLib::Systems::PhysicalInterfaceSettings> settings);
 	virtual ~ISonosInterface();
 
@@ -46,6 +53,19 @@ public:
 	virtual std::string ttsProgram() { return ""; }
 	virtual std::string dataPath() { return ""; }
     virtual void sendPacket(std::shared_ptr<BaseLib::Systems::Packet> packet) {}
+
+    /**
+     * Registers an event subscription, so events received for the SID can be assigned to the peer and the service.
+     *
+     * @param service The event path of the service, e. g. "/MediaRenderer/AVTransport/Event".
+     */
+    virtual void registerSubscription(const std::string& sid, const std::string& serialNumber, uint64_t peerId, const std::string& service) {}
+    virtual void unregisterSubscription(const std::string& sid) {}
+
+    /**
+     * @return Returns the number of active subscriptions and the events received per service.
+     */
+    virtual std::map<std::string, EventStatistics> eventStatistics() { return std::map<std::string, EventStatistics>(); }
 protected:
 	BaseLib::Output _out;
 };
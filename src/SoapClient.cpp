@@ -0,0 +1,276 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "SoapClient.h"
+#include "GD.h"
+
+namespace Sonos
+{
+
+SoapClient::SoapClient()
+{
+	_stopThreads = true;
+}
+
+SoapClient::~SoapClient()
+{
+	stop();
+}
+
+void SoapClient::start()
+{
+	try
+	{
+		stop();
+
+		std::string settingName = "soapthreads";
+		BaseLib::Systems::FamilySettings::PFamilySetting setting = GD::family->getFamilySetting(settingName);
+		if(setting) _threadCount = setting->integerValue;
+		if(_threadCount < 1) _threadCount = 1;
+		else if(_threadCount > 32) _threadCount = 32;
+
+		_stopThreads = false;
+		_threads.resize(_threadCount);
+		for(auto& thread : _threads)
+		{
+			GD::bl->threadManager.start(thread, true, &SoapClient::worker, this);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SoapClient::stop()
+{
+	try
+	{
+		{
+			std::lock_guard<std::mutex> queuesGuard(_queuesMutex);
+			_stopThreads = true;
+		}
+		_queuesConditionVariable.notify_all();
+		for(auto& thread : _threads)
+		{
+			GD::bl->threadManager.join(thread);
+		}
+		_threads.clear();
+
+		std::lock_guard<std::mutex> queuesGuard(_queuesMutex);
+		_queues.clear();
+		_readyKeys.clear();
+		_pending = 0;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+bool SoapClient::send(uint64_t key, std::shared_ptr<HttpClientPool> httpClientPool, const std::string& request, Callback callback, const std::string& group, int64_t deadline)
+{
+	try
+	{
+		if(!httpClientPool) return false;
+		Callback supersededCallback;
+		bool newKey = false;
+		{
+			std::lock_guard<std::mutex> queuesGuard(_queuesMutex);
+			if(_stopThreads) return false;
+			auto queueIterator = _queues.find(key);
+			newKey = queueIterator == _queues.end();
+			if(newKey) queueIterator = _queues.emplace(key, std::deque<Request>()).first;
+			std::deque<Request>& queue = queueIterator->second;
+
+			Request entry;
+			entry.httpClientPool = std::move(httpClientPool);
+			entry.request = request;
+			entry.callback = std::move(callback);
+			entry.group = group;
+			entry.deadline = deadline;
+
+			//The front request might already be sent, so it is never replaced. The new request takes the place of the superseded one, so the
+			//order relative to requests of other groups is kept.
+			bool replaced = false;
+			if(!group.empty() && queue.size() > 1)
+			{
+				for(auto i = queue.end(); i != queue.begin() + 1;)
+				{
+					--i;
+					if(i->group.empty()) break;
+					if(i->group == group)
+					{
+						supersededCallback = std::move(i->callback);
+						*i = std::move(entry);
+						replaced = true;
+						_superseded++;
+						break;
+					}
+				}
+			}
+
+			if(!replaced)
+			{
+				queue.push_back(std::move(entry));
+				_pending++;
+			}
+			//When the key already has a queue, the thread working on it picks up the new request.
+			if(newKey) _readyKeys.push_back(key);
+		}
+		if(newKey) _queuesConditionVariable.notify_one();
+		if(supersededCallback)
+		{
+			try
+			{
+				Response response;
+				response.dropReason = "superseded";
+				supersededCallback(response);
+			}
+			catch(const std::exception& ex)
+			{
+				GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+SoapClient::Response SoapClient::sendNow(HttpClientPool& httpClientPool, const std::string& request)
+{
+	Response response;
+	int64_t startTime = BaseLib::HelperFunctions::getTime();
+	try
+	{
+		BaseLib::Http http;
+		httpClientPool.sendRequest(request, http);
+		response.responseCode = http.getHeader().responseCode;
+		response.content.assign(http.getContent().data(), http.getContentSize());
+	}
+	catch(const BaseLib::HttpClientException& ex)
+	{
+		response.responseCode = ex.responseCode();
+		response.error = ex.what();
+	}
+	catch(const std::exception& ex)
+	{
+		response.responseCode = -1;
+		response.error = ex.what();
+	}
+	response.duration = BaseLib::HelperFunctions::getTime() - startTime;
+	return response;
+}
+
+size_t SoapClient::pending(uint64_t key)
+{
+	try
+	{
+		std::lock_guard<std::mutex> queuesGuard(_queuesMutex);
+		auto queueIterator = _queues.find(key);
+		return queueIterator == _queues.end() ? 0 : queueIterator->second.size();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return 0;
+}
+
+size_t SoapClient::pending()
+{
+	std::lock_guard<std::mutex> queuesGuard(_queuesMutex);
+	return _pending;
+}
+
+void SoapClient::worker()
+{
+	while(!_stopThreads)
+	{
+		try
+		{
+			uint64_t key = 0;
+			Request request;
+			{
+				std::unique_lock<std::mutex> queuesGuard(_queuesMutex);
+				_queuesConditionVariable.wait(queuesGuard, [&] { return !_readyKeys.empty() || _stopThreads; });
+				if(_stopThreads) return;
+				key = _readyKeys.front();
+				_readyKeys.pop_front();
+				auto queueIterator = _queues.find(key);
+				if(queueIterator == _queues.end() || queueIterator->second.empty()) continue;
+				//Leave the request in the queue while it is sent, so "send()" knows the key is being worked on.
+				request = queueIterator->second.front();
+			}
+
+			Response response;
+			if(request.deadline > 0 && BaseLib::HelperFunctions::getTime() > request.deadline)
+			{
+				response.dropReason = "expired";
+				_expired++;
+			}
+			else response = sendNow(*request.httpClientPool, request.request);
+			if(request.callback)
+			{
+				try
+				{
+					request.callback(response);
+				}
+				catch(const std::exception& ex)
+				{
+					GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> queuesGuard(_queuesMutex);
+				auto queueIterator = _queues.find(key);
+				if(queueIterator == _queues.end()) continue;
+				queueIterator->second.pop_front();
+				if(_pending > 0) _pending--;
+				if(queueIterator->second.empty()) _queues.erase(queueIterator);
+				else
+				{
+					_readyKeys.push_back(key);
+					_queuesConditionVariable.notify_one();
+				}
+			}
+		}
+		catch(const std::exception& ex)
+		{
+			GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+	}
+}
+
+}
@@ -0,0 +1,176 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef SOAPCLIENT_H_
+#define SOAPCLIENT_H_
+
+#include "HttpClientPool.h"
+
+#include <homegear-base/BaseLib.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace Sonos
+{
+
+/**
+ * Sends SOAP requests in the background and reports the responses through callbacks, so callers don't block on slow or unreachable speakers.
+ * Requests with the same key (the peer ID) are sent one at a time in the order they were queued, requests with different keys are sent in
+ * parallel.
+ *
+ * Requests can be assigned to a group of idempotent commands overriding each other (e. g. "SetVolume"). Only the latest queued request of a
+ * group is sent. Requests with a deadline are dropped when they couldn't be sent in time.
+ */
+class SoapClient
+{
+public:
+	struct Response
+	{
+		/**
+		 * The HTTP response code or -1 when the speaker could not be reached.
+		 */
+		int32_t responseCode = -1;
+		std::string content;
+
+		/**
+		 * Set when the request failed with an exception.
+		 */
+		std::string error;
+
+		/**
+		 * The round trip time in milliseconds.
+		 */
+		int64_t duration = 0;
+
+		/**
+		 * Set when the request was not sent: "superseded" when a newer request of the same group replaced it, "expired" when its deadline
+		 * passed before it could be sent.
+		 */
+		std::string dropReason;
+
+		bool success() const { return responseCode >= 200 && responseCode <= 299; }
+		bool dropped() const { return !dropReason.empty(); }
+	};
+
+	/**
+	 * Called from one of the client's threads when a request is completed. The callback may take the content of the response.
+	 */
+	typedef std::function<void(Response& response)> Callback;
+
+	SoapClient();
+	virtual ~SoapClient();
+
+	/**
+	 * Reads the settings and starts the threads.
+	 */
+	void start();
+
+	/**
+	 * Stops the threads. Requests not sent yet are discarded without calling their callbacks.
+	 */
+	void stop();
+
+	/**
+	 * Queues a request.
+	 *
+	 * @param key Requests with the same key are sent in order.
+	 * @param httpClientPool The connections to the speaker.
+	 * @param request The complete HTTP request.
+	 * @param callback Called with the response. Can be empty.
+	 * @param group When not empty, a queued request of the same key and group is replaced in place by this one, so it keeps its queue
+	 * position. Requests are never moved past queued requests without a group.
+	 * @param deadline Time in milliseconds since epoch after which the request is not sent anymore. "0" means no deadline.
+	 * @return Returns false when the client is stopped.
+	 */
+	bool send(uint64_t key, std::shared_ptr<HttpClientPool> httpClientPool, const std::string& request, Callback callback, const std::string& group = "", int64_t deadline = 0);
+
+	/**
+	 * Sends a request and waits for the response.
+	 */
+	static Response sendNow(HttpClientPool& httpClientPool, const std::string& request);
+
+	/**
+	 * @return Returns the number of queued and running requests of a key.
+	 */
+	size_t pending(uint64_t key);
+
+	/**
+	 * @return Returns the number of queued and running requests.
+	 */
+	size_t pending();
+
+	/**
+	 * @return Returns the number of requests replaced by newer ones.
+	 */
+	uint64_t superseded() { return _superseded; }
+
+	/**
+	 * @return Returns the number of requests dropped because of their deadline.
+	 */
+	uint64_t expired() { return _expired; }
+protected:
+	struct Request
+	{
+		std::shared_ptr<HttpClientPool> httpClientPool;
+		std::string request;
+		Callback callback;
+		std::string group;
+		int64_t deadline = 0;
+	};
+
+	std::atomic_bool _stopThreads;
+	int32_t _threadCount = 4;
+	std::vector<std::thread> _threads;
+	std::mutex _queuesMutex;
+	std::condition_variable _queuesConditionVariable;
+
+	/**
+	 * The front request of a queue is the one being sent. A queue is removed when it is empty.
+	 */
+	std::unordered_map<uint64_t, std::deque<Request>> _queues;
+
+	/**
+	 * Keys with queued requests that are not being worked on.
+	 */
+	std::deque<uint64_t> _readyKeys;
+	size_t _pending = 0;
+	std::atomic<uint64_t> _superseded{0};
+	std::atomic<uint64_t> _expired{0};
+
+	void worker();
+};
+
+}
+
+#endif
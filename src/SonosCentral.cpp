@@ -30,6 +30,7 @@
 #include "SonosCentral.h"
 #include "GD.h"
 
+#include <atomic>
 #include <iomanip>
 
 namespace Sonos {
@@ -58,8 +59,20 @@ void SonosCentral::dispose(bool wait)
 		GD::out.printDebug("Removing device " + std::to_string(_deviceId) + " from physical device's event queue...");
 		GD::physicalInterface->removeEventHandler(_physicalInterfaceEventhandlers[GD::physicalInterface->getID()]);
 		_stopWorkerThread = true;
+		{
+			std::lock_guard<std::mutex> scheduleGuard(_scheduleMutex);
+			_scheduleConditionVariable.notify_all();
+			_readyConditionVariable.notify_all();
+		}
 		GD::out.printDebug("Debug: Waiting for worker thread of device " + std::to_string(_deviceId) + "...");
 		GD::bl->threadManager.join(_workerThread);
+		for(auto& thread : _taskThreads)
+		{
+			GD::bl->threadManager.join(thread);
+		}
+		_taskThreads.clear();
+		if(_soapClient) _soapClient->stop();
+		if(_parameterWriteBuffer) _parameterWriteBuffer->stop();
 		_ssdp.reset();
 	}
     catch(const std::exception& ex)
@@ -71,6 +84,49 @@ void SonosCentral::dispose(bool wait)
 void SonosCentral::homegearShuttingDown()
 {
 	_shuttingDown = true;
+	{
+		std::lock_guard<std::mutex> scheduleGuard(_scheduleMutex);
+		_scheduleConditionVariable.notify_all();
+		_readyConditionVariable.notify_all();
+	}
+	try
+	{
+		//Cancel the event subscriptions, so the speakers stop sending events to us.
+		std::vector<std::shared_ptr<SonosPeer>> peers;
+		{
+			std::lock_guard<std::mutex> peersGuard(_peersMutex);
+			peers.reserve(_peersById.size());
+			for(auto& peer : _peersById)
+			{
+				std::shared_ptr<SonosPeer> sonosPeer = std::dynamic_pointer_cast<SonosPeer>(peer.second);
+				if(sonosPeer) peers.push_back(sonosPeer);
+			}
+		}
+		//Unreachable speakers each block until the read timeout, so the speakers are unsubscribed in parallel.
+		std::atomic<size_t> nextPeer{0};
+		auto unsubscribePeers = [&]()
+		{
+			for(size_t i = nextPeer++; i < peers.size(); i = nextPeer++)
+			{
+				peers.at(i)->unsubscribe();
+			}
+		};
+		std::vector<std::thread> threads(std::min(peers.size(), (size_t)32));
+		for(auto& thread : threads)
+		{
+			GD::bl->threadManager.start(thread, true, unsubscribePeers);
+		}
+		for(auto& thread : threads)
+		{
+			GD::bl->threadManager.join(thread);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	//Write everything still buffered. Values set after this are written directly.
+	if(_parameterWriteBuffer) _parameterWriteBuffer->stop();
 }
 
 void SonosCentral::init()
@@ -92,6 +148,64 @@ void SonosCentral::init()
 		if(_tempMaxAge < 1) _tempMaxAge = 1;
 		else if(_tempMaxAge > 87600) _tempMaxAge = 87600;
 
+		settingName = "workerthreads";
+		BaseLib::Systems::FamilySettings::PFamilySetting workerThreadsSetting = GD::family->getFamilySetting(settingName);
+		if(workerThreadsSetting) _workerThreadCount = workerThreadsSetting->integerValue;
+		if(_workerThreadCount < 1) _workerThreadCount = 1;
+		else if(_workerThreadCount > 32) _workerThreadCount = 32;
+
+		settingName = "positionsyncinterval";
+		BaseLib::Systems::FamilySettings::PFamilySetting positionSyncIntervalSetting = GD::family->getFamilySetting(settingName);
+		if(positionSyncIntervalSetting) _positionSyncInterval = positionSyncIntervalSetting->integerValue;
+		if(_positionSyncInterval < 0) _positionSyncInterval = 0;
+		else if(_positionSyncInterval > 0 && _positionSyncInterval < 5000) _positionSyncInterval = 5000;
+
+		settingName = "commandtimeout";
+		BaseLib::Systems::FamilySettings::PFamilySetting commandTimeoutSetting = GD::family->getFamilySetting(settingName);
+		if(commandTimeoutSetting) _commandTimeout = commandTimeoutSetting->integerValue;
+		if(_commandTimeout < 1000) _commandTimeout = 1000;
+		else if(_commandTimeout > 120000) _commandTimeout = 120000;
+
+		settingName = "announcementmode";
+		BaseLib::Systems::FamilySettings::PFamilySetting announcementModeSetting = GD::family->getFamilySetting(settingName);
+		if(announcementModeSetting)
+		{
+			std::string announcementMode = announcementModeSetting->stringValue;
+			BaseLib::HelperFunctions::toLower(BaseLib::HelperFunctions::trim(announcementMode));
+			_directAnnouncements = (announcementMode == "direct");
+		}
+
+		settingName = "volatilevariables";
+		BaseLib::Systems::FamilySettings::PFamilySetting volatileVariablesSetting = GD::family->getFamilySetting(settingName);
+		if(volatileVariablesSetting)
+		{
+			std::vector<std::string> volatileVariables = BaseLib::HelperFunctions::splitAll(volatileVariablesSetting->stringValue, ',');
+			for(auto& variable : volatileVariables)
+			{
+				BaseLib::HelperFunctions::trim(variable);
+				if(!variable.empty()) _volatileVariables.emplace(BaseLib::HelperFunctions::toUpper(variable));
+			}
+		}
+		else _volatileVariables = std::unordered_set<std::string>{ "CURRENT_TRACK_RELATIVE_TIME", "CURRENT_TRACK_ABSOLUTE_TIME", "CURRENT_TRACK_RELATIVE_COUNT", "CURRENT_TRACK_ABSOLUTE_COUNT", "TRANSPORT_STATE", "CURRENT_TRACK_STREAM_CONTENT", "NEXT_TRACK_STREAM_CONTENT" };
+
+		_parameterWriteBuffer.reset(new ParameterWriteBuffer([this](uint64_t peerId, uint32_t channel, const std::string& key, std::vector<uint8_t>& data)
+		{
+			std::shared_ptr<SonosPeer> peer = getPeer(peerId);
+			if(peer && !peer->deleting) peer->writeVariable(channel, key, data);
+		}));
+		_parameterWriteBuffer->start();
+
+		_soapClient.reset(new SoapClient());
+		_soapClient->start();
+
+		_ttsCache.reset(new TtsCache());
+		_ttsCache->cleanUp();
+
+		_taskThreads.resize(_workerThreadCount);
+		for(auto& thread : _taskThreads)
+		{
+			GD::bl->threadManager.start(thread, true, _bl->settings.workerThreadPriority(), _bl->settings.workerThreadPolicy(), &SonosCentral::taskWorker, this);
+		}
 		GD::bl->threadManager.start(_workerThread, true, _bl->settings.workerThreadPriority(), _bl->settings.workerThreadPolicy(), &SonosCentral::worker, this);
 	}
 	catch(const std::exception& ex)
@@ -126,6 +240,25 @@ void SonosCentral::deleteOldTempFiles()
 	}
 }
 
+void SonosCentral::schedulePeer(uint64_t peerId)
+{
+	try
+	{
+		std::lock_guard<std::mutex> scheduleGuard(_scheduleMutex);
+		if(!_scheduledPeers.emplace(peerId).second) return;
+		//Spread the first run of all peers over five seconds so the requests don't hit the network at the same time.
+		int64_t deadline = BaseLib::HelperFunctions::getTime() + BaseLib::HelperFunctions::getRandomNumber(0, 5000);
+		_schedule.push(ScheduledTask{deadline, peerId, PeerTask::subscriptions});
+		_schedule.push(ScheduledTask{deadline, peerId, PeerTask::mediaInfo});
+		_schedule.push(ScheduledTask{deadline, peerId, PeerTask::positionInfo});
+		_scheduleConditionVariable.notify_all();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
 void SonosCentral::worker()
 {
 	try
@@ -135,59 +268,54 @@ void SonosCentral::worker()
 			std::this_thread::sleep_for(std::chrono::seconds(1));
 		}
 
-		std::chrono::milliseconds sleepingTime(200);
-		uint32_t counter = 0;
-		uint32_t countsPer10Minutes = BaseLib::HelperFunctions::getRandomNumber(50, 3000);
-		uint64_t lastPeer;
-		lastPeer = 0;
+		std::vector<uint64_t> peerIds;
+		{
+			std::lock_guard<std::mutex> peersGuard(_peersMutex);
+			peerIds.reserve(_peersById.size());
+			for(auto& peer : _peersById) peerIds.push_back(peer.first);
+		}
+		for(auto peerId : peerIds) schedulePeer(peerId);
+
+		int64_t nextRediscovery = BaseLib::HelperFunctions::getTime() + BaseLib::HelperFunctions::getRandomNumber(10000, 600000);
 
-		//One loop on the Raspberry Pi takes about 30µs
 		while(!_stopWorkerThread && !_shuttingDown)
 		{
 			try
 			{
-				std::this_thread::sleep_for(sleepingTime);
-				if(_stopWorkerThread || _shuttingDown) return;
-				// Update devices (most importantly the IP address)
-				if(counter > countsPer10Minutes)
+				std::unique_lock<std::mutex> scheduleGuard(_scheduleMutex);
+				int64_t now = BaseLib::HelperFunctions::getTime();
+				if(nextRediscovery <= now)
 				{
-					counter = 0;
-					_peersMutex.lock();
-					if(_peersById.size() > 0)
-					{
-						int32_t windowTimePerPeer = _bl->settings.workerThreadWindow() / _peersById.size();
-						if(windowTimePerPeer > 2) windowTimePerPeer -= 2;
-						sleepingTime = std::chrono::milliseconds(windowTimePerPeer);
-						countsPer10Minutes = 600000 / windowTimePerPeer;
-					}
-					else countsPer10Minutes = 100;
-					_peersMutex.unlock();
+					// Update devices (most importantly the IP address)
+					nextRediscovery = now + 600000;
+					scheduleGuard.unlock();
 					searchDevices(nullptr, true);
 					deleteOldTempFiles();
+					if(_ttsCache) _ttsCache->cleanUp();
+					continue;
 				}
-				_peersMutex.lock();
-				if(!_peersById.empty())
+
+				//Hand due tasks to the task threads. Tasks of a peer that is still being worked on wait until it is done.
+				while(!_schedule.empty() && _schedule.top().deadline <= now)
 				{
-					if(!_peersById.empty())
+					ScheduledTask task = _schedule.top();
+					_schedule.pop();
+					if(_busyPeers.find(task.peerId) != _busyPeers.end()) _deferredTasks[task.peerId].push_back(task);
+					else
 					{
-						std::map<uint64_t, std::shared_ptr<BaseLib::Systems::Peer>>::iterator nextPeer = _peersById.find(lastPeer);
-						if(nextPeer != _peersById.end())
-						{
-							nextPeer++;
-							if(nextPeer == _peersById.end()) nextPeer = _peersById.begin();
-						}
-						else nextPeer = _peersById.begin();
-						lastPeer = nextPeer->first;
+						_busyPeers.emplace(task.peerId);
+						_readyTasks.push_back(task);
+						_readyConditionVariable.notify_one();
 					}
 				}
-				_peersMutex.unlock();
-				std::shared_ptr<SonosPeer> peer(getPeer(lastPeer));
-				if(peer && !peer->deleting) peer->worker();
-				counter++;
+
+				//Sleep until the next task is due. New peers, finished tasks and shutdown wake us up early.
+				int64_t deadline = nextRediscovery;
+				if(!_schedule.empty() && _schedule.top().deadline < deadline) deadline = _schedule.top().deadline;
+				_scheduleConditionVariable.wait_for(scheduleGuard, std::chrono::milliseconds(deadline - now));
 			}
 			catch(const std::exception& ex)
 			{
-				_peersMutex.unlock();
 				GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
 			}
 		}
@@ -198,6 +326,103 @@ void SonosCentral::worker()
     }
 }
 
+bool SonosCentral::electHouseholdSubscriber(const std::string& householdId, uint64_t peerId)
+{
+	try
+	{
+		if(householdId.empty()) return false;
+		std::lock_guard<std::mutex> householdSubscribersGuard(_householdSubscribersMutex);
+		auto subscriberIterator = _householdSubscribers.find(householdId);
+		if(subscriberIterator == _householdSubscribers.end())
+		{
+			_householdSubscribers.emplace(householdId, peerId);
+			GD::out.printInfo("Info: Peer " + std::to_string(peerId) + " subscribes to the household events of household \"" + householdId + "\".");
+			return true;
+		}
+		if(subscriberIterator->second == peerId) return true;
+
+		std::shared_ptr<SonosPeer> subscriber = getPeer(subscriberIterator->second);
+		if(subscriber && !subscriber->deleting && subscriber->isReachable()) return false;
+
+		GD::out.printInfo("Info: Peer " + std::to_string(peerId) + " takes over the household events of household \"" + householdId + "\" from peer " + std::to_string(subscriberIterator->second) + ".");
+		subscriberIterator->second = peerId;
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+void SonosCentral::taskWorker()
+{
+	try
+	{
+		while(!_stopWorkerThread && !_shuttingDown)
+		{
+			try
+			{
+				ScheduledTask task;
+				{
+					std::unique_lock<std::mutex> scheduleGuard(_scheduleMutex);
+					_readyConditionVariable.wait(scheduleGuard, [&] { return !_readyTasks.empty() || _stopWorkerThread || _shuttingDown; });
+					if(_stopWorkerThread || _shuttingDown) return;
+					task = _readyTasks.front();
+					_readyTasks.pop_front();
+				}
+
+				int64_t startTime = BaseLib::HelperFunctions::getTime();
+				std::shared_ptr<SonosPeer> peer(getPeer(task.peerId));
+				int64_t interval = (peer && !peer->deleting) ? peer->runTask(task.task) : -1;
+				int64_t endTime = BaseLib::HelperFunctions::getTime();
+
+				std::lock_guard<std::mutex> scheduleGuard(_scheduleMutex);
+				_busyPeers.erase(task.peerId);
+				if(interval < 0)
+				{
+					//Drop the peer. Its remaining tasks are discarded when they become due.
+					_scheduledPeers.erase(task.peerId);
+					_deferredTasks.erase(task.peerId);
+					_peerTaskStats.erase(task.peerId);
+				}
+				else if(_scheduledPeers.find(task.peerId) != _scheduledPeers.end())
+				{
+					PeerTaskStats& stats = _peerTaskStats[task.peerId];
+					stats.runs++;
+					stats.lastDuration = endTime - startTime;
+					if(stats.lastDuration > stats.maxDuration) stats.maxDuration = stats.lastDuration;
+					stats.lastLag = startTime - task.deadline;
+					if(stats.lastLag > stats.maxLag) stats.maxLag = stats.lastLag;
+
+					auto deferredIterator = _deferredTasks.find(task.peerId);
+					if(deferredIterator != _deferredTasks.end())
+					{
+						for(auto& deferredTask : deferredIterator->second)
+						{
+							_schedule.push(deferredTask);
+						}
+						_deferredTasks.erase(deferredIterator);
+					}
+
+					task.deadline += interval;
+					if(task.deadline < endTime) task.deadline = endTime + interval; //Don't catch up on missed runs
+					_schedule.push(task);
+				}
+				_scheduleConditionVariable.notify_all();
+			}
+			catch(const std::exception& ex)
+			{
+				GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
 bool SonosCentral::onPacketReceived(std::string& senderID, std::shared_ptr<BaseLib::Systems::Packet> packet)
 {
 	try
@@ -205,8 +430,29 @@ bool SonosCentral::onPacketReceived(std::string& senderID, std::shared_ptr<BaseL
 		if(_disposing) return false;
 		std::shared_ptr<SonosPacket> sonosPacket(std::dynamic_pointer_cast<SonosPacket>(packet));
 		if(!sonosPacket) return false;
-		std::shared_ptr<SonosPeer> peer(getPeer(sonosPacket->serialNumber()));
+		//Events of known subscriptions carry the peer id. Use the serial number for everything else.
+		std::shared_ptr<SonosPeer> peer(sonosPacket->peerId() != 0 ? getPeer(sonosPacket->peerId()) : getPeer(sonosPacket->serialNumber()));
 		if(!peer) return false;
+		if(SonosPeer::isHouseholdService(sonosPacket->service()))
+		{
+			//Household-wide events are only received from one speaker. Pass them to all speakers of the household.
+			std::string householdId = peer->getHouseholdId();
+			std::vector<std::shared_ptr<SonosPeer>> householdPeers;
+			{
+				std::lock_guard<std::mutex> peersGuard(_peersMutex);
+				householdPeers.reserve(_peersById.size());
+				for(auto& element : _peersById)
+				{
+					std::shared_ptr<SonosPeer> householdPeer = std::dynamic_pointer_cast<SonosPeer>(element.second);
+					if(householdPeer && !householdPeer->deleting && householdPeer->getHouseholdId() == householdId) householdPeers.push_back(householdPeer);
+				}
+			}
+			for(auto& householdPeer : householdPeers)
+			{
+				householdPeer->packetReceived(sonosPacket);
+			}
+			return false;
+		}
 		peer->packetReceived(sonosPacket);
 	}
 	catch(const std::exception& ex)
@@ -232,6 +478,7 @@ void SonosCentral::loadPeers()
 			if(!peer->getSerialNumber().empty()) _peersBySerial[peer->getSerialNumber()] = peer;
 			_peersById[peerID] = peer;
 			_peersMutex.unlock();
+			schedulePeer(peerID);
 		}
 	}
 	catch(const std::exception& ex)
@@ -304,6 +551,7 @@ void SonosCentral::savePeers(bool full)
 {
 	try
 	{
+		if(_parameterWriteBuffer) _parameterWriteBuffer->flush();
 		_peersMutex.lock();
 		for(std::map<uint64_t, std::shared_ptr<BaseLib::Systems::Peer>>::iterator i = _peersById.begin(); i != _peersById.end(); ++i)
 		{
@@ -360,6 +608,8 @@ void SonosCentral::deletePeer(uint64_t id)
         }
         if(i == 600) GD::out.printError("Error: Peer deletion took too long.");
 
+		if(_parameterWriteBuffer) _parameterWriteBuffer->removePeer(id);
+		peer->unsubscribe();
 		peer->deleteFromDatabase();
 
 		GD::out.printMessage("Removed Sonos peer " + std::to_string(peer->getID()));
@@ -386,6 +636,8 @@ std::string SonosCentral::handleCliCommand(std::string command)
 			stringStream << "peers setname (pn)\tName a peer" << std::endl;
 			stringStream << "search (sp)\t\tSearches for new devices" << std::endl;
 			stringStream << "unselect (u)\t\tUnselect this device" << std::endl;
+			stringStream << "events (ev)\t\tShows the subscriptions and events received per service" << std::endl;
+			stringStream << "workers (ws)\t\tShows timing statistics of the background tasks" << std::endl;
 			return stringStream.str();
 		}
 		if(command.compare(0, 12, "peers remove") == 0 || command.compare(0, 2, "pr") == 0)
@@ -662,6 +914,101 @@ std::string SonosCentral::handleCliCommand(std::string command)
 			else stringStream << "Search completed successfully." << std::endl;
 			return stringStream.str();
 		}
+		else if(command.compare(0, 6, "events") == 0 || command.compare(0, 2, "ev") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = 0; //Both forms are a single word
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command shows the number of active subscriptions and the number and size of the events received per UPnP service since the start." << std::endl;
+						stringStream << "Usage: events" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			std::map<std::string, ISonosInterface::EventStatistics> statistics = GD::physicalInterface->eventStatistics();
+			stringStream << std::setfill(' ')
+				<< std::setw(40) << "Service" << " │ "
+				<< std::setw(13) << "Subscriptions" << " │ "
+				<< std::setw(10) << "Events" << " │ "
+				<< std::setw(12) << "Bytes" << std::endl;
+			stringStream << "─────────────────────────────────────────┼───────────────┼────────────┼─────────────" << std::endl;
+			for(auto& service : statistics)
+			{
+				stringStream << std::setw(40) << service.first << " │ "
+					<< std::setw(13) << service.second.subscriptions << " │ "
+					<< std::setw(10) << service.second.events << " │ "
+					<< std::setw(12) << service.second.bytes << std::endl;
+			}
+			return stringStream.str();
+		}
+		else if(command.compare(0, 7, "workers") == 0 || command.compare(0, 2, "ws") == 0)
+		{
+			std::stringstream stream(command);
+			std::string element;
+			int32_t offset = 0; //Both forms are a single word
+			int32_t index = 0;
+			while(std::getline(stream, element, ' '))
+			{
+				if(index < 1 + offset)
+				{
+					index++;
+					continue;
+				}
+				else if(index == 1 + offset)
+				{
+					if(element == "help")
+					{
+						stringStream << "Description: This command shows timing statistics of the background tasks (polling and subscription renewal) of each peer." << std::endl;
+						stringStream << "\"Lag\" is the time a task had to wait after it was due. All times are in milliseconds." << std::endl;
+						stringStream << "Usage: workers" << std::endl << std::endl;
+						stringStream << "Parameters:" << std::endl;
+						stringStream << "  There are no parameters." << std::endl;
+						return stringStream.str();
+					}
+				}
+				index++;
+			}
+
+			std::lock_guard<std::mutex> scheduleGuard(_scheduleMutex);
+			stringStream << "Worker threads: " << _workerThreadCount << ", busy peers: " << _busyPeers.size() << ", queued tasks: " << _readyTasks.size() << ", pending SOAP requests: " << (_soapClient ? _soapClient->pending() : 0) << std::endl;
+			if(_soapClient) stringStream << "Superseded commands: " << _soapClient->superseded() << ", expired commands: " << _soapClient->expired() << std::endl;
+			stringStream << std::endl;
+			stringStream << std::setfill(' ')
+				<< std::setw(8) << "ID" << " │ "
+				<< std::setw(8) << "Runs" << " │ "
+				<< std::setw(10) << "Last Time" << " │ "
+				<< std::setw(10) << "Max Time" << " │ "
+				<< std::setw(10) << "Last Lag" << " │ "
+				<< std::setw(10) << "Max Lag" << std::endl;
+			stringStream << "─────────┼──────────┼────────────┼────────────┼────────────┼───────────" << std::endl;
+			std::map<uint64_t, PeerTaskStats> sortedStats(_peerTaskStats.begin(), _peerTaskStats.end());
+			for(auto& stats : sortedStats)
+			{
+				stringStream << std::setw(8) << stats.first << " │ "
+					<< std::setw(8) << stats.second.runs << " │ "
+					<< std::setw(10) << stats.second.lastDuration << " │ "
+					<< std::setw(10) << stats.second.maxDuration << " │ "
+					<< std::setw(10) << stats.second.lastLag << " │ "
+					<< std::setw(10) << stats.second.maxLag << std::endl;
+			}
+			return stringStream.str();
+		}
 		else return "Unknown command.\n";
 	}
 	catch(const std::exception& ex)
@@ -940,6 +1287,7 @@ PVariable SonosCentral::searchDevices(BaseLib::PRpcClientInfo clientInfo, bool u
 					GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
 				}
 				_peersMutex.unlock();
+				schedulePeer(peer->getID());
 				GD::out.printMessage("Added peer " + std::to_string(peer->getID()) + ".");
 				newPeers.push_back(peer);
 			}
@@ -32,10 +32,19 @@
 
 #include <homegear-base/BaseLib.h>
 #include "SonosPeer.h"
+#include "ParameterWriteBuffer.h"
+#include "SoapClient.h"
+#include "TtsCache.h"
 
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace Sonos
 {
@@ -62,6 +71,45 @@ public:
 
 	virtual void homegearShuttingDown();
 
+	ParameterWriteBuffer* parameterWriteBuffer() { return _parameterWriteBuffer.get(); }
+
+	/**
+	 * Sends SOAP requests without blocking the caller.
+	 */
+	SoapClient* soapClient() { return _soapClient.get(); }
+
+	/**
+	 * Cache of generated TTS audio files shared by all peers.
+	 */
+	TtsCache* ttsCache() { return _ttsCache.get(); }
+
+	/**
+	 * Interval in milliseconds in which the interpolated playback position is checked against the speaker. "0" disables the check.
+	 */
+	int64_t positionSyncInterval() { return _positionSyncInterval; }
+
+	/**
+	 * Time in milliseconds after which a queued command is dropped when it couldn't be sent to the speaker.
+	 */
+	int64_t commandTimeout() { return _commandTimeout; }
+
+	/**
+	 * When true, announcements are played by setting the clip as transport URI instead of inserting it into the queue.
+	 */
+	bool directAnnouncements() { return _directAnnouncements; }
+
+	/**
+	 * Elects the peer subscribing to the household-wide services of a household. The current peer stays elected as long as it is reachable.
+	 *
+	 * @return Returns true when "peerId" is the elected peer. Returns false when the household ID is empty.
+	 */
+	bool electHouseholdSubscriber(const std::string& householdId, uint64_t peerId);
+
+	/**
+	 * Volatile variables are kept in memory and raise events, but are never written to the database.
+	 */
+	bool isVolatileVariable(const std::string& key) { return _volatileVariables.find(key) != _volatileVariables.end(); }
+
 	virtual PVariable addLink(BaseLib::PRpcClientInfo clientInfo, std::string senderSerialNumber, int32_t senderChannel, std::string receiverSerialNumber, int32_t receiverChannel, std::string name, std::string description);
 	virtual PVariable addLink(BaseLib::PRpcClientInfo clientInfo, uint64_t senderID, int32_t senderChannel, uint64_t receiverID, int32_t receiverChannel, std::string name, std::string description);
 	virtual PVariable deleteDevice(BaseLib::PRpcClientInfo clientInfo, std::string serialNumber, int32_t flags);
@@ -71,19 +119,69 @@ public:
 	virtual PVariable searchDevices(BaseLib::PRpcClientInfo clientInfo, const std::string& interfaceId);
 	virtual PVariable searchDevices(BaseLib::PRpcClientInfo clientInfo, bool updateOnly);
 protected:
+	/**
+	 * A peer task due at "deadline" (in milliseconds since epoch).
+	 */
+	struct ScheduledTask
+	{
+		int64_t deadline = 0;
+		uint64_t peerId = 0;
+		PeerTask task = PeerTask::positionInfo;
+
+		bool operator>(const ScheduledTask& other) const { return deadline > other.deadline; }
+	};
+
+	/**
+	 * Timing of the background tasks of one peer. Times are in milliseconds. "Lag" is the time a task waited past its deadline.
+	 */
+	struct PeerTaskStats
+	{
+		uint64_t runs = 0;
+		int64_t lastDuration = 0;
+		int64_t maxDuration = 0;
+		int64_t lastLag = 0;
+		int64_t maxLag = 0;
+	};
+
 	std::unique_ptr<BaseLib::Ssdp> _ssdp;
 	std::atomic_bool _shuttingDown;
 
 	std::atomic_bool _stopWorkerThread;
 	std::thread _workerThread;
 
+	std::mutex _scheduleMutex;
+	std::condition_variable _scheduleConditionVariable;
+	std::priority_queue<ScheduledTask, std::vector<ScheduledTask>, std::greater<ScheduledTask>> _schedule;
+	std::unordered_set<uint64_t> _scheduledPeers;
+	std::condition_variable _readyConditionVariable;
+	std::deque<ScheduledTask> _readyTasks;
+	std::unordered_set<uint64_t> _busyPeers;
+	std::unordered_map<uint64_t, std::vector<ScheduledTask>> _deferredTasks;
+	std::unordered_map<uint64_t, PeerTaskStats> _peerTaskStats;
+	std::vector<std::thread> _taskThreads;
+
+	std::mutex _householdSubscribersMutex;
+	std::unordered_map<std::string, uint64_t> _householdSubscribers;
+
 	std::mutex _searchDevicesMutex;
 
+	int32_t _workerThreadCount = 4;
+	int64_t _positionSyncInterval = 60000;
+	int64_t _commandTimeout = 10000;
+	bool _directAnnouncements = false;
+
+	std::unique_ptr<ParameterWriteBuffer> _parameterWriteBuffer;
+	std::unique_ptr<SoapClient> _soapClient;
+	std::unique_ptr<TtsCache> _ttsCache;
+	std::unordered_set<std::string> _volatileVariables;
+
 	uint32_t _tempMaxAge = 720;
 
 	std::shared_ptr<SonosPeer> createPeer(uint32_t deviceType, std::string serialNumber, std::string ip, std::string softwareVersion, std::string idString, std::string typeString, bool save = true);
 	void deletePeer(uint64_t id);
+	void schedulePeer(uint64_t peerId);
 	void worker();
+	void taskWorker();
 	void init();
 	void deleteOldTempFiles();
 };
@@ -34,21 +34,288 @@ namespace Sonos
 {
 SonosPacket::SonosPacket()
 {
-	_values.reset(new std::unordered_map<std::string, std::string>());
+	_values.reset(new ValueMap());
 	_valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
 }
 
-SonosPacket::SonosPacket(std::string& soap, int64_t timeReceived)
+SonosPacket::SonosPacket(std::string&& soap, int64_t timeReceived)
 {
 	try
 	{
-		BaseLib::HelperFunctions::trim(soap);
-		_values.reset(new std::unordered_map<std::string, std::string>());
+		_values.reset(new ValueMap());
 		_valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
 		_timeReceived = timeReceived;
 		if(soap.empty()) return;
+		_arena.emplace_back(std::move(soap));
+		parse(&_arena.back().at(0), _arena.back().size());
+	}
+	catch(const std::exception& ex)
+    {
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+SonosPacket::SonosPacket(std::string&& soap, std::string serialNumber, int64_t timeReceived) : SonosPacket(std::move(soap), timeReceived)
+{
+	_serialNumber = serialNumber;
+}
+
+SonosPacket::SonosPacket(const std::shared_ptr<std::vector<char>>& buffer, char* escapedXml, size_t size, std::string serialNumber, int64_t timeReceived)
+{
+	try
+	{
+		_values.reset(new ValueMap());
+		_valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
+		_timeReceived = timeReceived;
+		_serialNumber = serialNumber;
+		_buffer = buffer;
+		if(!escapedXml || size == 0) return;
+		//Decoding never makes the data longer, so there always is space for the null termination.
+		size = decodeEntities(escapedXml, size);
+		escapedXml[size] = 0;
+		parse(escapedXml, size);
+	}
+	catch(const std::exception& ex)
+    {
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+SonosPacket::SonosPacket(xml_node* node, const std::shared_ptr<std::vector<char>>& buffer, std::string serialNumber, int64_t timeReceived)
+{
+	try
+	{
+		_values.reset(new ValueMap());
+		_valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
+		_timeReceived = timeReceived;
+		_serialNumber = serialNumber;
+		_buffer = buffer;
+		if(!node) return;
+		_functionName = "InfoBroadcast2";
+		for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
+		{
+			_values->operator [](std::string_view(subNode->name(), subNode->name_size())) = std::string_view(subNode->value(), subNode->value_size());
+		}
+	}
+	catch(const std::exception& ex)
+    {
+        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+SonosPacket::SonosPacket(std::string& ip, std::string& path, std::string& soapAction, std::string& schema, std::string& functionName, std::shared_ptr<std::vector<std::pair<std::string, std::string>>> valuesToSet)
+{
+	_ip = ip;
+	_path = path;
+	_soapAction = soapAction;
+	_schema = schema;
+	_functionName = functionName;
+	_valuesToSet = valuesToSet;
+	if(!_valuesToSet) _valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
+	_values.reset(new ValueMap());
+}
+
+SonosPacket::~SonosPacket()
+{
+}
+
+size_t SonosPacket::decodeEntities(char* data, size_t size)
+{
+	size_t readPos = 0;
+	size_t writePos = 0;
+	while(readPos < size)
+	{
+		char* ampersand = (char*)memchr(data + readPos, '&', size - readPos);
+		size_t end = ampersand ? ampersand - data : size;
+		if(writePos != readPos) memmove(data + writePos, data + readPos, end - readPos);
+		writePos += end - readPos;
+		readPos = end;
+		if(!ampersand) break;
+
+		char* semicolon = (char*)memchr(data + readPos, ';', std::min(size - readPos, (size_t)12));
+		if(!semicolon)
+		{
+			data[writePos++] = data[readPos++];
+			continue;
+		}
+		std::string_view entity(data + readPos + 1, semicolon - data - readPos - 1);
+		size_t entitySize = entity.size() + 2;
+		if(entity == "lt") data[writePos++] = '<';
+		else if(entity == "gt") data[writePos++] = '>';
+		else if(entity == "amp") data[writePos++] = '&';
+		else if(entity == "quot") data[writePos++] = '"';
+		else if(entity == "apos") data[writePos++] = '\'';
+		else if(entity.size() > 1 && entity.front() == '#')
+		{
+			uint32_t codePoint = 0;
+			bool valid = true;
+			bool hex = entity.at(1) == 'x' || entity.at(1) == 'X';
+			for(size_t i = hex ? 2 : 1; i < entity.size(); i++)
+			{
+				char c = entity.at(i);
+				if(c >= '0' && c <= '9') codePoint = codePoint * (hex ? 16 : 10) + (c - '0');
+				else if(hex && c >= 'a' && c <= 'f') codePoint = codePoint * 16 + (c - 'a' + 10);
+				else if(hex && c >= 'A' && c <= 'F') codePoint = codePoint * 16 + (c - 'A' + 10);
+				else valid = false;
+				if(codePoint > 0x10FFFF) valid = false;
+				if(!valid) break;
+			}
+			if(!valid || codePoint == 0 || entity.size() == (hex ? 2u : 1u))
+			{
+				data[writePos++] = data[readPos++];
+				continue;
+			}
+			//The UTF-8 encoding is always shorter than the entity.
+			if(codePoint < 0x80) data[writePos++] = (char)codePoint;
+			else if(codePoint < 0x800)
+			{
+				data[writePos++] = (char)(0xC0 | (codePoint >> 6));
+				data[writePos++] = (char)(0x80 | (codePoint & 0x3F));
+			}
+			else if(codePoint < 0x10000)
+			{
+				data[writePos++] = (char)(0xE0 | (codePoint >> 12));
+				data[writePos++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+				data[writePos++] = (char)(0x80 | (codePoint & 0x3F));
+			}
+			else
+			{
+				data[writePos++] = (char)(0xF0 | (codePoint >> 18));
+				data[writePos++] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+				data[writePos++] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+				data[writePos++] = (char)(0x80 | (codePoint & 0x3F));
+			}
+		}
+		else
+		{
+			data[writePos++] = data[readPos++];
+			continue;
+		}
+		readPos += entitySize;
+	}
+	return writePos;
+}
+
+std::string_view SonosPacket::toArena(std::string value)
+{
+	_arena.emplace_back(std::move(value));
+	return std::string_view(_arena.back());
+}
+
+char* SonosPacket::decodeToArena(std::string_view escapedData)
+{
+	_arena.emplace_back(escapedData);
+	std::string& data = _arena.back();
+	data.resize(decodeEntities(&data.at(0), data.size()));
+	return &data.at(0);
+}
+
+SonosPacket::TrackMetadata::Field SonosPacket::TrackMetadata::fieldFromName(std::string_view name)
+{
+	if(name == "dc:title") return Field::title;
+	else if(name == "dc:creator") return Field::creator;
+	else if(name == "upnp:album") return Field::album;
+	else if(name == "upnp:albumArtURI") return Field::albumArtUri;
+	else if(name == "res") return Field::res;
+	else if(name == "protocolInfo") return Field::protocolInfo;
+	else if(name == "duration") return Field::duration;
+	else if(name == "r:streamContent") return Field::streamContent;
+	return Field::count;
+}
+
+void SonosPacket::TrackMetadata::set(std::string_view name, std::string_view value)
+{
+	Field field = fieldFromName(name);
+	if(field != Field::count)
+	{
+		_fields[(size_t)field] = value;
+		_setFields |= 1u << (uint32_t)field;
+		return;
+	}
+	for(auto& element : _overflow)
+	{
+		if(element.first == name)
+		{
+			element.second = value;
+			return;
+		}
+	}
+	_overflow.emplace_back(name, value);
+}
+
+bool SonosPacket::TrackMetadata::get(std::string_view name, std::string_view& value) const
+{
+	Field field = fieldFromName(name);
+	if(field != Field::count)
+	{
+		if(!(_setFields & (1u << (uint32_t)field))) return false;
+		value = _fields[(size_t)field];
+		return true;
+	}
+	for(auto& element : _overflow)
+	{
+		if(element.first == name)
+		{
+			value = element.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+const SonosPacket::TrackMetadata& SonosPacket::metadata(MetadataType type)
+{
+	uint32_t mask = 1u << (uint32_t)type;
+	if(!(_decodedMetadata & mask))
+	{
+		_decodedMetadata |= mask;
+		parseMetadata(_rawMetadata.at((size_t)type), _metadata.at((size_t)type));
+	}
+	return _metadata.at((size_t)type);
+}
+
+void SonosPacket::parseMetadata(std::string_view escapedMetadata, TrackMetadata& metadata)
+{
+	try
+	{
+		metadata = TrackMetadata();
+		if(escapedMetadata.empty()) return;
+		//The raw value is still referenced by _values, so the metadata is decoded in a copy.
+		xml_document metadataDoc;
+		metadataDoc.parse<parse_no_entity_translation>(decodeToArena(escapedMetadata));
+		xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
+		if(!metadataNode) return;
+		metadataNode = metadataNode->first_node("item");
+		if(!metadataNode) return;
+		for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
+		{
+			metadata.set(std::string_view(metadataAttribute->name(), metadataAttribute->name_size()), std::string_view(metadataAttribute->value(), metadataAttribute->value_size()));
+		}
+		for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
+		{
+			std::string_view metadataName(metadataSubNode->name(), metadataSubNode->name_size());
+			metadata.set(metadataName, std::string_view(metadataSubNode->value(), metadataSubNode->value_size()));
+			if(metadataName == "res")
+			{
+				for(xml_attribute* metadataAttribute = metadataSubNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
+				{
+					metadata.set(std::string_view(metadataAttribute->name(), metadataAttribute->name_size()), std::string_view(metadataAttribute->value(), metadataAttribute->value_size()));
+				}
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPacket::parse(char* xml, size_t size)
+{
+	try
+	{
 		xml_document doc;
-		doc.parse<parse_no_entity_translation>(&soap.at(0));
+		doc.parse<parse_no_entity_translation>(xml);
 		xml_node* node = doc.first_node("s:Envelope");
 		if(!node) //Info packet
 		{
@@ -67,157 +334,22 @@ SonosPacket::SonosPacket(std::string& soap, int64_t timeReceived)
 			}
 			for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
 			{
-				std::string name(subNode->name());
+				std::string_view name(subNode->name(), subNode->name_size());
 				xml_attribute* attr = subNode->first_attribute("val");
 				xml_attribute* channel = subNode->first_attribute("channel");
-				if(channel) name.append(std::string(channel->value()));
+				if(channel) name = toArena(std::string(name).append(channel->value(), channel->value_size()));
 				if(!attr)
 				{
-					GD::out.printWarning("Warning: Tried to parse element without attribute: " + name);
+					GD::out.printWarning("Warning: Tried to parse element without attribute: " + std::string(name));
 					continue;
 				}
-				std::string value(attr->value());
-				if(name == "CurrentTrackMetaData" || name == "TrackMetaData")
-				{
-					_values->operator [](name) = value;
-					_currentTrackMetadata.reset(new std::unordered_map<std::string, std::string>());
-					if(value.empty()) continue;
-					std::string xml;
-					BaseLib::Html::unescapeHtmlEntities(value, xml);
-					xml_document metadataDoc;
-					metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
-					xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
-					if(!metadataNode) continue;
-					metadataNode = metadataNode->first_node("item");
-					if(!metadataNode) continue;
-					for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-					{
-						_currentTrackMetadata->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-					}
-					for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
-					{
-						std::string metadataName(metadataSubNode->name());
-						if(metadataName == "res")
-						{
-							_currentTrackMetadata->operator [](metadataName) = std::string(metadataSubNode->value());
-							for(xml_attribute* metadataAttribute = metadataSubNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-							{
-								_currentTrackMetadata->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-							}
-						}
-						else
-						{
-							_currentTrackMetadata->operator [](std::string(metadataSubNode->name())) = std::string(metadataSubNode->value());
-						}
-					}
-				}
-				else if(name == "r:NextTrackMetaData")
-				{
-					_values->operator [](name) = value;
-					_nextTrackMetadata.reset(new std::unordered_map<std::string, std::string>());
-					if(value.empty()) continue;
-					std::string xml;
-					BaseLib::Html::unescapeHtmlEntities(value, xml);
-					xml_document metadataDoc;
-					metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
-					xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
-					if(!metadataNode) continue;
-					metadataNode = metadataNode->first_node("item");
-					if(!metadataNode) continue;
-					for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-					{
-						_nextTrackMetadata->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-					}
-					for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
-					{
-						std::string metadataName(metadataSubNode->name());
-						if(metadataName == "res")
-						{
-							_nextTrackMetadata->operator [](metadataName) = std::string(metadataSubNode->value());
-							for(xml_attribute* metadataAttribute = metadataSubNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-							{
-								_nextTrackMetadata->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-							}
-						}
-						else
-						{
-							_nextTrackMetadata->operator [](std::string(metadataSubNode->name())) = std::string(metadataSubNode->value());
-						}
-					}
-				}
-				else if(name == "AVTransportURIMetaData")
-				{
-					_values->operator [](name) = value;
-					_avTransportUriMetaData.reset(new std::unordered_map<std::string, std::string>());
-					if(value.empty()) continue;
-					std::string xml;
-					BaseLib::Html::unescapeHtmlEntities(value, xml);
-					xml_document metadataDoc;
-					metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
-					xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
-					if(!metadataNode) continue;
-					metadataNode = metadataNode->first_node("item");
-					if(!metadataNode) continue;
-					for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-					{
-						_avTransportUriMetaData->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-					}
-					for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
-					{
-						std::string metadataName(metadataSubNode->name());
-						_avTransportUriMetaData->operator [](std::string(metadataSubNode->name())) = std::string(metadataSubNode->value());
-					}
-				}
-				else if(name == "NextAVTransportURIMetaData")
-				{
-					_values->operator [](name) = value;
-					_nextAvTransportUriMetaData.reset(new std::unordered_map<std::string, std::string>());
-					if(value.empty()) continue;
-					std::string xml;
-					BaseLib::Html::unescapeHtmlEntities(value, xml);
-					xml_document metadataDoc;
-					metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
-					xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
-					if(!metadataNode) continue;
-					metadataNode = metadataNode->first_node("item");
-					if(!metadataNode) continue;
-					for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-					{
-						_nextAvTransportUriMetaData->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-					}
-					for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
-					{
-						std::string metadataName(metadataSubNode->name());
-						_nextAvTransportUriMetaData->operator [](std::string(metadataSubNode->name())) = std::string(metadataSubNode->value());
-					}
-				}
-				else if(name == "r:EnqueuedTransportURIMetaData")
-				{
-					_values->operator [](name) = value;
-					_enqueuedTransportUriMetaData.reset(new std::unordered_map<std::string, std::string>());
-					if(value.empty()) continue;
-					std::string xml;
-					BaseLib::Html::unescapeHtmlEntities(value, xml);
-					xml_document metadataDoc;
-					metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
-					xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
-					if(!metadataNode) continue;
-					metadataNode = metadataNode->first_node("item");
-					if(!metadataNode) continue;
-					for(xml_attribute* metadataAttribute = metadataNode->first_attribute(); metadataAttribute; metadataAttribute = metadataAttribute->next_attribute())
-					{
-						_enqueuedTransportUriMetaData->operator [](std::string(metadataAttribute->name())) = std::string(metadataAttribute->value());
-					}
-					for(xml_node* metadataSubNode = metadataNode->first_node(); metadataSubNode; metadataSubNode = metadataSubNode->next_sibling())
-					{
-						std::string metadataName(metadataSubNode->name());
-						_enqueuedTransportUriMetaData->operator [](std::string(metadataSubNode->name())) = std::string(metadataSubNode->value());
-					}
-				}
-				else
-				{
-					_values->operator [](name) = value;
-				}
+				std::string_view value(attr->value(), attr->value_size());
+				_values->operator [](name) = value;
+				if(name == "CurrentTrackMetaData" || name == "TrackMetaData") _rawMetadata[(size_t)MetadataType::currentTrack] = value;
+				else if(name == "r:NextTrackMetaData") _rawMetadata[(size_t)MetadataType::nextTrack] = value;
+				else if(name == "AVTransportURIMetaData") _rawMetadata[(size_t)MetadataType::avTransportUri] = value;
+				else if(name == "NextAVTransportURIMetaData") _rawMetadata[(size_t)MetadataType::nextAvTransportUri] = value;
+				else if(name == "r:EnqueuedTransportURIMetaData") _rawMetadata[(size_t)MetadataType::enqueuedTransportUri] = value;
 			}
 		}
 		else
@@ -226,17 +358,14 @@ SonosPacket::SonosPacket(std::string& soap, int64_t timeReceived)
 			if(!node) return;
 			node = node->first_node();
 			if(!node) return;
-			_functionName = std::string(node->name());
+			_functionName = std::string(node->name(), node->name_size());
 			if(_functionName.size() > 2) _functionName = _functionName.substr(2);
 			if(_functionName == "BrowseResponse")
 			{
 				xml_node* subNode = node->first_node("Result");
 				if(!subNode) return;
-				std::string value(subNode->value());
-				std::string xml;
-				BaseLib::Html::unescapeHtmlEntities(value, xml);
 				xml_document metadataDoc;
-				metadataDoc.parse<parse_no_entity_translation>((char*)xml.data());
+				metadataDoc.parse<parse_no_entity_translation>(decodeToArena(std::string_view(subNode->value(), subNode->value_size())));
 				xml_node* metadataNode = metadataDoc.first_node("DIDL-Lite");
 				if(!metadataNode) return;
 				_browseResult.reset(new std::pair<std::string, BaseLib::PVariable>("", BaseLib::PVariable(new Variable(VariableType::tArray))));
@@ -286,63 +415,18 @@ SonosPacket::SonosPacket(std::string& soap, int64_t timeReceived)
 			{
 				for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
 				{
-					_values->operator [](std::string(subNode->name())) = std::string(subNode->value());
+					_values->operator [](std::string_view(subNode->name(), subNode->name_size())) = std::string_view(subNode->value(), subNode->value_size());
 				}
 			}
 		}
 	}
 	catch(const std::exception& ex)
     {
-		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, std::string(ex.what()) + " Packet was: " + soap);
-    }
-}
-
-SonosPacket::SonosPacket(std::string& soap, std::string serialNumber, int64_t timeReceived) : SonosPacket(soap, timeReceived)
-{
-	_serialNumber = serialNumber;
-}
-
-SonosPacket::SonosPacket(xml_node* node, int64_t timeReceived )
-{
-	try
-	{
-		if(!node) return;
-		_values.reset(new std::unordered_map<std::string, std::string>());
-		_valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
-		_timeReceived = timeReceived;
-		_functionName = "InfoBroadcast2";
-		for(xml_node* subNode = node->first_node(); subNode; subNode = subNode->next_sibling())
-		{
-			_values->operator [](std::string(subNode->name())) = std::string(subNode->value());
-		}
-	}
-	catch(const std::exception& ex)
-    {
-        GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		//The data was modified in place by the parser, so it can't be printed anymore.
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, std::string(ex.what()) + " Packet size was: " + std::to_string(size) + " bytes.");
     }
 }
 
-SonosPacket::SonosPacket(xml_node* node, std::string serialNumber, int64_t timeReceived) : SonosPacket(node, timeReceived)
-{
-	_serialNumber = serialNumber;
-}
-
-SonosPacket::SonosPacket(std::string& ip, std::string& path, std::string& soapAction, std::string& schema, std::string& functionName, std::shared_ptr<std::vector<std::pair<std::string, std::string>>> valuesToSet)
-{
-	_ip = ip;
-	_path = path;
-	_soapAction = soapAction;
-	_schema = schema;
-	_functionName = functionName;
-	_valuesToSet = valuesToSet;
-	if(!_valuesToSet) _valuesToSet.reset(new std::vector<std::pair<std::string, std::string>>());
-	_values.reset(new std::unordered_map<std::string, std::string>());
-}
-
-SonosPacket::~SonosPacket()
-{
-}
-
 void SonosPacket::getSoapRequest(std::string& request)
 {
 	try
@@ -354,7 +438,7 @@ void SonosPacket::getSoapRequest(std::string& request)
 		}
 		request += "</u:" + _functionName + "></s:Body></s:Envelope>";
 
-		std::string header = "POST " + _path + " HTTP/1.1\r\nCONNECTION: close\r\nHOST: " + _ip + ":1400\r\nCONTENT-LENGTH: " + std::to_string(request.size()) + "\r\nCONTENT-TYPE: text/xml; charset=\"utf-8\"\r\nSOAPACTION: \"" + _soapAction + "\"\r\n\r\n";
+		std::string header = "POST " + _path + " HTTP/1.1\r\nCONNECTION: keep-alive\r\nHOST: " + _ip + ":1400\r\nCONTENT-LENGTH: " + std::to_string(request.size()) + "\r\nCONTENT-TYPE: text/xml; charset=\"utf-8\"\r\nSOAPACTION: \"" + _soapAction + "\"\r\n\r\n";
 		request.insert(request.begin(), header.begin(), header.end());
 	}
 	catch(const std::exception& ex)
@@ -33,6 +33,9 @@
 #include <homegear-base/BaseLib.h>
 #include "homegear-base/Encoding/RapidXml/rapidxml.h"
 
+#include <array>
+#include <deque>
+#include <string_view>
 #include <unordered_map>
 
 namespace Sonos
@@ -41,27 +44,102 @@ namespace Sonos
 class SonosPacket : public BaseLib::Systems::Packet
 {
     public:
+        /**
+         * Values are views into the memory owned by the packet. Element names and values are stored as received, i. e. with entities not decoded.
+         */
+        typedef std::unordered_map<std::string_view, std::string_view> ValueMap;
+        typedef std::shared_ptr<ValueMap> PValueMap;
+
+        /**
+         * The content of a DIDL-Lite metadata document. The fields used most are stored in a fixed array, all others in a small overflow list.
+         */
+        class TrackMetadata
+        {
+            public:
+                enum class Field : int32_t
+                {
+                    title,
+                    creator,
+                    album,
+                    albumArtUri,
+                    res,
+                    protocolInfo,
+                    duration,
+                    streamContent,
+                    count
+                };
+
+                /**
+                 * @return The field for the element or attribute name or Field::count when the name has no own field.
+                 */
+                static Field fieldFromName(std::string_view name);
+
+                bool empty() const { return _setFields == 0 && _overflow.empty(); }
+                void set(std::string_view name, std::string_view value);
+                bool get(std::string_view name, std::string_view& value) const;
+            private:
+                uint32_t _setFields = 0;
+                std::array<std::string_view, (size_t)Field::count> _fields;
+                std::vector<std::pair<std::string_view, std::string_view>> _overflow;
+        };
+
         SonosPacket();
-        SonosPacket(std::string& soap, std::string serialNumber, int64_t timeReceived = 0);
-        SonosPacket(std::string& soap, int64_t timeReceived = 0);
-        SonosPacket(xml_node* node, std::string serialNumber, int64_t timeReceived = 0);
-        SonosPacket(xml_node* node, int64_t timeReceived = 0);
+        /**
+         * Creates a packet from a SOAP response or an info packet. The packet takes ownership of the data, as its values point into it.
+         */
+        SonosPacket(std::string&& soap, std::string serialNumber, int64_t timeReceived = 0);
+        SonosPacket(std::string&& soap, int64_t timeReceived = 0);
+
+        /**
+         * Creates a packet from an escaped XML document (e. g. the content of "LastChange") within the buffer. The document is decoded and parsed in place.
+         */
+        SonosPacket(const std::shared_ptr<std::vector<char>>& buffer, char* escapedXml, size_t size, std::string serialNumber, int64_t timeReceived = 0);
+        SonosPacket(xml_node* node, const std::shared_ptr<std::vector<char>>& buffer, std::string serialNumber, int64_t timeReceived = 0);
         SonosPacket(std::string& ip, std::string& path, std::string& soapAction, std::string& schema, std::string& functionName, std::shared_ptr<std::vector<std::pair<std::string, std::string>>> valuesToSet);
         virtual ~SonosPacket();
 
+        /**
+         * Decodes XML entities in place. Unknown entities are kept as they are.
+         *
+         * @return The size of the decoded data. The data is not null terminated.
+         */
+        static size_t decodeEntities(char* data, size_t size);
+
         std::string ip() { return _ip; }
         std::string serialNumber() { return _serialNumber; }
         std::string path() { return _path; }
         std::string soapAction() { return _soapAction; }
         std::string schema() { return _schema; }
         std::string functionName() { return _functionName; }
+
+        /**
+         * The peer and the event path of the subscription an event was received for. Only set for events with a known SID.
+         */
+        uint64_t peerId() { return _peerId; }
+        void setPeerId(uint64_t value) { _peerId = value; }
+        const std::string& service() { return _service; }
+        void setService(const std::string& value) { _service = value; }
         std::shared_ptr<std::pair<std::string, BaseLib::PVariable>> browseResult() { return _browseResult; }
-        std::shared_ptr<std::unordered_map<std::string, std::string>> values() { return _values; }
-        std::shared_ptr<std::unordered_map<std::string, std::string>> currentTrackMetadata() { return _currentTrackMetadata; }
-        std::shared_ptr<std::unordered_map<std::string, std::string>> nextTrackMetadata() { return _nextTrackMetadata; }
-        std::shared_ptr<std::unordered_map<std::string, std::string>>avTransportUriMetaData() { return _avTransportUriMetaData; }
-        std::shared_ptr<std::unordered_map<std::string, std::string>> nextAvTransportUriMetaData() { return _nextAvTransportUriMetaData; }
-        std::shared_ptr<std::unordered_map<std::string, std::string>> enqueuedTransportUriMetaData() { return _enqueuedTransportUriMetaData; }
+        PValueMap values() { return _values; }
+        enum class MetadataType : int32_t
+        {
+            currentTrack,
+            nextTrack,
+            avTransportUri,
+            nextAvTransportUri,
+            enqueuedTransportUri,
+            count
+        };
+
+        /**
+         * Metadata documents are only decoded when they are requested for the first time. The result is kept for the lifetime of the packet.
+         */
+        const TrackMetadata& metadata(MetadataType type);
+        const TrackMetadata& currentTrackMetadata() { return metadata(MetadataType::currentTrack); }
+        const TrackMetadata& nextTrackMetadata() { return metadata(MetadataType::nextTrack); }
+        const TrackMetadata& avTransportUriMetaData() { return metadata(MetadataType::avTransportUri); }
+        const TrackMetadata& nextAvTransportUriMetaData() { return metadata(MetadataType::nextAvTransportUri); }
+        const TrackMetadata& enqueuedTransportUriMetaData() { return metadata(MetadataType::enqueuedTransportUri); }
 
         std::shared_ptr<std::vector<std::pair<std::string, std::string>>> valuesToSet() { return _valuesToSet; }
 
@@ -77,13 +155,35 @@ class SonosPacket : public BaseLib::Systems::Packet
         std::string _soapAction;
         std::string _schema;
         std::string _functionName;
-        std::shared_ptr<std::unordered_map<std::string, std::string>> _values;
-        std::shared_ptr<std::unordered_map<std::string, std::string>> _currentTrackMetadata;
-        std::shared_ptr<std::unordered_map<std::string, std::string>> _nextTrackMetadata;
-        std::shared_ptr<std::unordered_map<std::string, std::string>> _avTransportUriMetaData;
-        std::shared_ptr<std::unordered_map<std::string, std::string>> _nextAvTransportUriMetaData;
-        std::shared_ptr<std::unordered_map<std::string, std::string>> _enqueuedTransportUriMetaData;
+        uint64_t _peerId = 0;
+        std::string _service;
+
+        /**
+         * The received data the values point into. Can be shared by several packets created from the same request.
+         */
+        std::shared_ptr<std::vector<char>> _buffer;
+
+        /**
+         * Additional memory owned by the packet, e. g. for decoded metadata or composed element names. Elements are never moved.
+         */
+        std::deque<std::string> _arena;
+
+        PValueMap _values;
+        std::array<std::string_view, (size_t)MetadataType::count> _rawMetadata;
+        std::array<TrackMetadata, (size_t)MetadataType::count> _metadata;
+        uint32_t _decodedMetadata = 0;
         std::shared_ptr<std::pair<std::string, BaseLib::PVariable>> _browseResult;
+
+        void parse(char* xml, size_t size);
+        void parseMetadata(std::string_view escapedMetadata, TrackMetadata& metadata);
+        std::string_view toArena(std::string value);
+
+        /**
+         * Copies escaped data to the arena and decodes it there.
+         *
+         * @return Pointer to the null terminated decoded data.
+         */
+        char* decodeToArena(std::string_view escapedData);
 };
 
 }
@@ -30,12 +30,16 @@
 #include "SonosPeer.h"
 #include "SonosCentral.h"
 #include "SonosPacket.h"
+#include "DispatchPlan.h"
+#include "SubscriptionManager.h"
+#include "HttpClientPool.h"
 #include "GD.h"
 
 #include <homegear-base/Managers/ProcessManager.h>
 
 #include "sys/wait.h"
 
+#include <future>
 #include <iomanip>
 
 namespace Sonos
@@ -80,16 +84,26 @@ SonosPeer::~SonosPeer()
 void SonosPeer::init()
 {
     _shuttingDown = false;
-    _getOneMorePositionInfo = true;
     _isMaster = false;
     _isStream = false;
 
 	_binaryEncoder.reset(new BaseLib::Rpc::RpcEncoder(GD::bl));
 	_binaryDecoder.reset(new BaseLib::Rpc::RpcDecoder(GD::bl));
 
+	SubscriptionManager::Listener subscriptionListener = [this](const std::string& sid, const std::string& service, bool active)
+	{
+		if(!GD::physicalInterface) return;
+		if(active) GD::physicalInterface->registerSubscription(sid, _serialNumber, _peerID, service);
+		else GD::physicalInterface->unregisterSubscription(sid);
+	};
+	_subscriptionManager.reset(new SubscriptionManager(std::vector<std::string>{ "/MediaRenderer/RenderingControl/Event", "/MediaRenderer/AVTransport/Event", "/MediaServer/ContentDirectory/Event" }, subscriptionListener));
+	_householdSubscriptionManager.reset(new SubscriptionManager(std::vector<std::string>{ "/ZoneGroupTopology/Event", "/AlarmClock/Event", "/SystemProperties/Event", "/MusicServices/Event" }, subscriptionListener));
+
+	_upnpFunctions.insert(UpnpFunctionPair("AddMultipleURIsToQueue", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("AddURIToQueue", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("Browse", UpnpFunctionEntry("urn:schemas-upnp-org:service:ContentDirectory:1", "/MediaServer/ContentDirectory/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("GetCrossfadeMode", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0") }))));
+	_upnpFunctions.insert(UpnpFunctionPair("GetHouseholdID", UpnpFunctionEntry("urn:schemas-upnp-org:service:DeviceProperties:1", "/DeviceProperties/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("GetMute", UpnpFunctionEntry("urn:schemas-upnp-org:service:RenderingControl:1", "/MediaRenderer/RenderingControl/Control", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Channel", "Master") }))));
 	_upnpFunctions.insert(UpnpFunctionPair("GetMediaInfo", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0") }))));
 	_upnpFunctions.insert(UpnpFunctionPair("GetPositionInfo", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0") }))));
@@ -103,6 +117,7 @@ void SonosPeer::init()
 	_upnpFunctions.insert(UpnpFunctionPair("RampToVolume", UpnpFunctionEntry("urn:schemas-upnp-org:service:RenderingControl:1", "/MediaRenderer/RenderingControl/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("RemoveAllTracksFromQueue", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0") }))));
 	_upnpFunctions.insert(UpnpFunctionPair("RemoveTrackFromQueue", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
+	_upnpFunctions.insert(UpnpFunctionPair("RemoveTrackRangeFromQueue", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("Seek", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("SetAVTransportURI", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
 	_upnpFunctions.insert(UpnpFunctionPair("SetCrossfadeMode", UpnpFunctionEntry("urn:schemas-upnp-org:service:AVTransport:1", "/MediaRenderer/AVTransport/Control", PSoapValues(new SoapValues()))));
@@ -116,13 +131,40 @@ void SonosPeer::setIp(std::string value)
 	try
 	{
 		Peer::setIp(value);
+		createHttpClientPool();
+		_subscriptionManager->reset();
+		_householdSubscriptionManager->reset();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPeer::createHttpClientPool()
+{
+	try
+	{
 		std::string settingName = "readtimeout";
 		BaseLib::Systems::FamilySettings::PFamilySetting readTimeoutSetting = GD::family->getFamilySetting(settingName);
 		int32_t readTimeout = 10000;
 		if(readTimeoutSetting) readTimeout = readTimeoutSetting->integerValue;
 		if(readTimeout < 1 || readTimeout > 120000) readTimeout = 10000;
-		_httpClient.reset(new BaseLib::HttpClient(GD::bl, _ip, 1400, false));
-		_httpClient->setTimeout(readTimeout);
+
+		settingName = "connectionidletimeout";
+		BaseLib::Systems::FamilySettings::PFamilySetting idleTimeoutSetting = GD::family->getFamilySetting(settingName);
+		int32_t idleTimeout = 20000;
+		if(idleTimeoutSetting) idleTimeout = idleTimeoutSetting->integerValue;
+		if(idleTimeout < 0 || idleTimeout > 3600000) idleTimeout = 20000;
+
+		settingName = "maxconnectionsperspeaker";
+		BaseLib::Systems::FamilySettings::PFamilySetting maxConnectionsSetting = GD::family->getFamilySetting(settingName);
+		int32_t maxConnections = 2;
+		if(maxConnectionsSetting) maxConnections = maxConnectionsSetting->integerValue;
+		if(maxConnections < 0 || maxConnections > 16) maxConnections = 2;
+
+		_readTimeout = readTimeout;
+		_httpClientPool = std::make_shared<HttpClientPool>(_ip, 1400, readTimeout, idleTimeout, maxConnections);
 	}
 	catch(const std::exception& ex)
 	{
@@ -149,6 +191,68 @@ std::string SonosPeer::getRinconId()
 	return "";
 }
 
+void SonosPeer::saveVariableValue(uint32_t channel, const std::string& key, std::vector<uint8_t>& data)
+{
+	try
+	{
+		std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+		if(central && central->isVolatileVariable(key)) return;
+		ParameterWriteBuffer* parameterWriteBuffer = central ? central->parameterWriteBuffer() : nullptr;
+		if(parameterWriteBuffer && parameterWriteBuffer->enabled()) parameterWriteBuffer->set(_peerID, channel, key, data);
+		else writeVariable(channel, key, data);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPeer::resetVolatileVariables(SonosCentral* central)
+{
+	try
+	{
+		if(!central) return;
+		for(auto& channelIterator : valuesCentral)
+		{
+			for(auto& parameterIterator : channelIterator.second)
+			{
+				BaseLib::Systems::RpcConfigurationParameter& parameter = parameterIterator.second;
+				if(!parameter.rpcParameter || !parameter.rpcParameter->logical || !central->isVolatileVariable(parameterIterator.first)) continue;
+				std::vector<uint8_t> parameterData;
+				parameter.rpcParameter->convertToPacket(parameter.rpcParameter->logical->getDefaultValue(), Role(), parameterData);
+				if(parameter.equals(parameterData)) continue;
+				parameter.setBinaryData(parameterData);
+				//Overwrite the stale row once, so it isn't loaded again on the next start.
+				if(parameter.databaseId > 0) writeVariable(channelIterator.first, parameterIterator.first, parameterData);
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPeer::writeVariable(uint32_t channel, const std::string& key, std::vector<uint8_t>& data)
+{
+	try
+	{
+		uint64_t databaseId = 0;
+		auto channelIterator = valuesCentral.find(channel);
+		if(channelIterator != valuesCentral.end())
+		{
+			auto parameterIterator = channelIterator->second.find(key);
+			if(parameterIterator != channelIterator->second.end()) databaseId = parameterIterator->second.databaseId;
+		}
+		if(databaseId > 0) saveParameter(databaseId, data);
+		else saveParameter(0, ParameterGroup::Type::Enum::variables, channel, key, data);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
 void SonosPeer::setRinconId(std::string value)
 {
 	try
@@ -159,8 +263,7 @@ void SonosPeer::setRinconId(std::string value)
 		configParameter.rpcParameter->convertToPacket(PVariable(new Variable(value)), Role(), parameterData);
 		if(configParameter.equals(parameterData)) return;
 		configParameter.setBinaryData(parameterData);
-		if(configParameter.databaseId > 0) saveParameter(configParameter.databaseId, parameterData);
-		else saveParameter(0, ParameterGroup::Type::Enum::variables, 1, "ID", parameterData);
+		saveVariableValue(1, "ID", parameterData);
 	}
 	catch(const std::exception& ex)
 	{
@@ -179,8 +282,7 @@ void SonosPeer::setRoomName(std::string value, bool broadCastEvent)
 		configParameter.rpcParameter->convertToPacket(variable, Role(), parameterData);
 		if(configParameter.equals(parameterData)) return;
 		configParameter.setBinaryData(parameterData);
-		if(configParameter.databaseId > 0) saveParameter(configParameter.databaseId, parameterData);
-		else saveParameter(0, ParameterGroup::Type::Enum::variables, 1, "ROOMNAME", parameterData);
+		saveVariableValue(1, "ROOMNAME", parameterData);
 
 		if(broadCastEvent)
 		{
@@ -198,90 +300,287 @@ void SonosPeer::setRoomName(std::string value, bool broadCastEvent)
 	}
 }
 
-void SonosPeer::worker()
+int64_t SonosPeer::runTask(PeerTask task)
 {
 	try
 	{
-		if(_shuttingDown || deleting) return;
-		std::shared_ptr<std::vector<std::string>> valueKeys(new std::vector<std::string>());
-		std::shared_ptr<std::vector<PVariable>> rpcValues(new std::vector<PVariable>());
-		if( BaseLib::HelperFunctions::getTimeSeconds() - _lastPositionInfo > 5 && !serviceMessages->getUnreach())
+		if(_shuttingDown || deleting) return -1;
+		switch(task)
 		{
-			_lastPositionInfo = BaseLib::HelperFunctions::getTimeSeconds();
-			//Get position info if TRANSPORT_STATE is PLAYING
-			std::unordered_map<uint32_t, std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>>::iterator channelIterator = valuesCentral.find(1);
-			if(channelIterator != valuesCentral.end())
+			case PeerTask::positionInfo:
+				updatePositionInfo();
+				return 5000;
+			case PeerTask::mediaInfo:
+				poll("GetMediaInfo");
+				return 60000;
+			case PeerTask::subscriptions:
+				return renewSubscriptions();
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	//Only stop scheduling the peer when it is shut down or deleted. After an error the task is retried.
+	return (_shuttingDown || deleting) ? -1 : 10000;
+}
+
+void SonosPeer::updatePositionInfo()
+{
+	try
+	{
+		if(serviceMessages->getUnreach()) return;
+		bool resync = _positionResyncRequested.exchange(false);
+		if(!resync)
+		{
+			std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+			int64_t syncInterval = central ? central->positionSyncInterval() : 0;
+			std::lock_guard<std::mutex> positionGuard(_positionMutex);
+			resync = _position.playing && syncInterval > 0 && monotonicTime() - _position.syncTime >= syncInterval;
+		}
+		if(!resync) return;
+		//The peer is alive while the completion is called.
+		bool queued = poll("GetPositionInfo", [this](bool success)
+		{
+			if(!success) _positionResyncRequested = true;
+		});
+		if(!queued) _positionResyncRequested = true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+int64_t SonosPeer::monotonicTime()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t SonosPeer::currentPosition()
+{
+	try
+	{
+		std::lock_guard<std::mutex> positionGuard(_positionMutex);
+		if(!_position.valid) return -1;
+		if(!_position.playing) return _position.relativeTime;
+		int64_t position = _position.relativeTime + (monotonicTime() - _position.syncTime) / 1000;
+		if(_position.duration > 0 && position > _position.duration) position = _position.duration;
+		return position;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return -1;
+}
+
+void SonosPeer::syncPosition()
+{
+	try
+	{
+		auto channelIterator = valuesCentral.find(1);
+		if(channelIterator == valuesCentral.end()) return;
+		auto getStoredValue = [&](const std::string& key) -> PVariable
+		{
+			auto parameterIterator = channelIterator->second.find(key);
+			if(parameterIterator == channelIterator->second.end()) return PVariable();
+			std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
+			if(parameterData.empty()) return PVariable();
+			return _binaryDecoder->decodeResponse(parameterData);
+		};
+		//The times are stored as "H:MM:SS" strings. Converting them applies the "timeStringSeconds" cast.
+		auto getStoredSeconds = [&](const std::string& key) -> PVariable
+		{
+			auto parameterIterator = channelIterator->second.find(key);
+			if(parameterIterator == channelIterator->second.end() || !parameterIterator->second.rpcParameter) return PVariable();
+			std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
+			if(parameterData.empty()) return PVariable();
+			return parameterIterator->second.rpcParameter->convertFromPacket(parameterData, Role(), false);
+		};
+
+		PVariable relativeTime = getStoredSeconds("CURRENT_TRACK_RELATIVE_TIME");
+		if(!relativeTime) return;
+		PVariable duration = getStoredSeconds("CURRENT_TRACK_DURATION");
+		PVariable transportState = getStoredValue("TRANSPORT_STATE");
+
+		int64_t expectedPosition = currentPosition();
+		std::lock_guard<std::mutex> positionGuard(_positionMutex);
+		if(_position.valid && _position.playing && GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Playback position of peer " + std::to_string(_peerID) + " drifted by " + std::to_string(relativeTime->integerValue - expectedPosition) + " s.");
+		_position.valid = true;
+		_position.relativeTime = relativeTime->integerValue;
+		_position.duration = duration ? duration->integerValue : 0;
+		if(transportState) _position.playing = (transportState->stringValue == "PLAYING");
+		_position.syncTime = monotonicTime();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPeer::setPosition(int64_t relativeTime)
+{
+	try
+	{
+		std::lock_guard<std::mutex> positionGuard(_positionMutex);
+		_position.valid = true;
+		_position.relativeTime = relativeTime;
+		_position.syncTime = monotonicTime();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPeer::setPlaying(bool playing)
+{
+	try
+	{
+		int64_t position = currentPosition();
+		std::lock_guard<std::mutex> positionGuard(_positionMutex);
+		if(_position.valid) _position.relativeTime = position;
+		_position.playing = playing;
+		_position.syncTime = monotonicTime();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+int64_t SonosPeer::renewSubscriptions()
+{
+	try
+	{
+		std::shared_ptr<HttpClientPool> httpClientPool = _httpClientPool;
+		if(!httpClientPool) return 300000;
+		std::string host = _ip + ":1400";
+		std::string callbackUrl = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort());
+		std::unordered_set<std::string> subscribedServices = getSubscribedServices();
+		_subscriptionManager->setEnabledServices(subscribedServices);
+		_householdSubscriptionManager->setEnabledServices(subscribedServices);
+		SubscriptionManager::UpdateResult result = _subscriptionManager->update(_peerID, *httpClientPool, host, callbackUrl);
+		if(!result.unreachable)
+		{
+			if(getHouseholdId().empty()) updateHouseholdId();
+			std::string householdId = getHouseholdId();
+			std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+			if(householdId.empty())
 			{
-				std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator parameterIterator = channelIterator->second.find("TRANSPORT_STATE");
-				if(parameterIterator != channelIterator->second.end())
-				{
-					std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
-					PVariable transportState = _binaryDecoder->decodeResponse(parameterData);
-					if(transportState)
-					{
-						if(transportState->stringValue == "PLAYING" || _getOneMorePositionInfo)
-						{
-							_getOneMorePositionInfo = (transportState->stringValue == "PLAYING");
-							execute("GetPositionInfo");
-						}
-					}
-				}
+				//Without the household ID, speakers of different households can't be told apart. Try again later.
+				result.nextUpdate = std::min(result.nextUpdate, (int64_t)60000);
+			}
+			else if(central && central->electHouseholdSubscriber(householdId, _peerID))
+			{
+				SubscriptionManager::UpdateResult householdResult = _householdSubscriptionManager->update(_peerID, *httpClientPool, host, callbackUrl);
+				result.nextUpdate = std::min(result.nextUpdate, householdResult.nextUpdate);
+				result.responded = result.responded || householdResult.responded;
+				result.unreachable = householdResult.unreachable;
+			}
+			else
+			{
+				//Another speaker took over, e. g. while this one was unreachable.
+				if(_householdSubscriptionManager->activeCount() > 0) _householdSubscriptionManager->unsubscribeAll(_peerID, *httpClientPool, host);
+				//Check regularly, so we can take over when the elected speaker becomes unreachable.
+				result.nextUpdate = std::min(result.nextUpdate, (int64_t)60000);
 			}
 		}
-		if( BaseLib::HelperFunctions::getTimeSeconds() - _lastAvTransportInfo > 60)
+		if(result.unreachable) serviceMessages->setUnreach(true, false);
+		else if(result.responded) serviceMessages->setUnreach(false, true);
+		return std::max(result.nextUpdate, (int64_t)1000);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return 300000;
+}
+
+void SonosPeer::unsubscribe()
+{
+	try
+	{
+		std::shared_ptr<HttpClientPool> httpClientPool = _httpClientPool;
+		if(!httpClientPool || serviceMessages->getUnreach())
 		{
-			_lastAvTransportInfo = BaseLib::HelperFunctions::getTimeSeconds();
-			execute("GetMediaInfo");
+			_subscriptionManager->reset();
+			_householdSubscriptionManager->reset();
+			return;
 		}
-		if(BaseLib::HelperFunctions::getTimeSeconds() - _lastAvTransportSubscription > 300)
+		_subscriptionManager->unsubscribeAll(_peerID, *httpClientPool, _ip + ":1400");
+		_householdSubscriptionManager->unsubscribeAll(_peerID, *httpClientPool, _ip + ":1400");
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+std::unordered_set<std::string> SonosPeer::getSubscribedServices()
+{
+	try
+	{
+		//The peer's configuration overrides the family setting.
+		std::string services;
+		auto channelIterator = configCentral.find(0);
+		if(channelIterator != configCentral.end())
 		{
-			_lastAvTransportSubscription = BaseLib::HelperFunctions::getTimeSeconds();
-			std::vector<std::string> subscriptionPackets(7);
-			subscriptionPackets.at(0) = "SUBSCRIBE /ZoneGroupTopology/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			subscriptionPackets.at(1) = "SUBSCRIBE /MediaRenderer/RenderingControl/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			subscriptionPackets.at(2) = "SUBSCRIBE /MediaRenderer/AVTransport/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			subscriptionPackets.at(3) = "SUBSCRIBE /MediaServer/ContentDirectory/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			subscriptionPackets.at(4) = "SUBSCRIBE /AlarmClock/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			subscriptionPackets.at(5) = "SUBSCRIBE /SystemProperties/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			subscriptionPackets.at(6) = "SUBSCRIBE /MusicServices/Event HTTP/1.1\r\nHOST: " + _ip + ":1400\r\nCALLBACK: <http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-1800\r\nContent-Length: 0\r\n\r\n";
-			if(_httpClient)
+			auto parameterIterator = channelIterator->second.find("SUBSCRIBED_SERVICES");
+			if(parameterIterator != channelIterator->second.end())
 			{
-				for(uint32_t i = 0; i < subscriptionPackets.size(); i++)
+				std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
+				if(!parameterData.empty())
 				{
-					BaseLib::Http response;
-					try
-					{
-						_httpClient->sendRequest(subscriptionPackets.at(i), response, true);
-						std::string stringResponse(response.getContent().data(), response.getContentSize());
-						if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: SOAP response:\n" + stringResponse);
-						if(response.getHeader().responseCode < 200 || response.getHeader().responseCode > 299)
-						{
-							GD::out.printWarning("Warning: Error calling SUBSCRIBE (" + std::to_string(i) + ") on Sonos device: Response code was: " + std::to_string(response.getHeader().responseCode));
-							if(response.getHeader().responseCode == -1)
-							{
-								//serviceMessages->setUnreach(true, false);
-								break;
-							}
-						}
-						serviceMessages->setUnreach(false, true);
-					}
-					catch(const BaseLib::HttpClientException& ex)
-					{
-						GD::out.printWarning("Warning: Error calling SUBSCRIBE (" + std::to_string(i) + ") on Sonos device: " + ex.what());
-						if(ex.responseCode() == -1)
-						{
-							serviceMessages->setUnreach(true, false);
-							break;
-						}
-					}
-					catch(const std::exception& ex)
-					{
-						GD::out.printWarning("Warning: Error calling SUBSCRIBE (" + std::to_string(i) + ") on Sonos device: " + ex.what());
-						break;
-					}
+					PVariable variable = _binaryDecoder->decodeResponse(parameterData);
+					if(variable) services = variable->stringValue;
 				}
 			}
 		}
+		BaseLib::HelperFunctions::trim(services);
+		if(services.empty())
+		{
+			std::string settingName = "subscribedservices";
+			BaseLib::Systems::FamilySettings::PFamilySetting subscribedServicesSetting = GD::family->getFamilySetting(settingName);
+			if(subscribedServicesSetting) services = subscribedServicesSetting->stringValue;
+			BaseLib::HelperFunctions::trim(services);
+		}
+		if(services.empty()) return std::unordered_set<std::string>{ "zonegrouptopology", "renderingcontrol", "avtransport", "contentdirectory", "alarmclock", "systemproperties", "musicservices" };
+
+		std::unordered_set<std::string> subscribedServices;
+		std::vector<std::string> elements = BaseLib::HelperFunctions::splitAll(services, ',');
+		for(auto& element : elements)
+		{
+			BaseLib::HelperFunctions::trim(element);
+			if(!element.empty()) subscribedServices.emplace(BaseLib::HelperFunctions::toLower(element));
+		}
+		return subscribedServices;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return std::unordered_set<std::string>();
+}
+
+bool SonosPeer::isHouseholdService(const std::string& service)
+{
+	return service == "/ZoneGroupTopology/Event" || service == "/AlarmClock/Event" || service == "/SystemProperties/Event" || service == "/MusicServices/Event";
+}
+
+std::string SonosPeer::getHouseholdId()
+{
+	std::lock_guard<std::mutex> householdIdGuard(_householdIdMutex);
+	return _householdId;
+}
+
+void SonosPeer::updateHouseholdId()
+{
+	try
+	{
+		//The response is handled in packetReceived().
+		execute("GetHouseholdID", true);
 	}
 	catch(const std::exception& ex)
 	{
@@ -574,12 +873,6 @@ void SonosPeer::loadVariables(BaseLib::Systems::ICentral* central, std::shared_p
 {
 	try
 	{
-		std::string settingName = "readtimeout";
-		BaseLib::Systems::FamilySettings::PFamilySetting readTimeoutSetting = GD::family->getFamilySetting(settingName);
-		int32_t readTimeout = 10000;
-		if(readTimeoutSetting) readTimeout = readTimeoutSetting->integerValue;
-		if(readTimeout < 1 || readTimeout > 120000) readTimeout = 10000;
-
 		if(!rows) rows = _bl->db->getPeerVariables(_peerID);
 		Peer::loadVariables(central, rows);
 		for(BaseLib::Database::DataTable::iterator row = rows->begin(); row != rows->end(); ++row)
@@ -592,8 +885,7 @@ void SonosPeer::loadVariables(BaseLib::Systems::ICentral* central, std::shared_p
 				break;
 			}
 		}
-		_httpClient.reset(new BaseLib::HttpClient(GD::bl, _ip, 1400, false));
-		_httpClient->setTimeout(readTimeout);
+		createHttpClientPool();
 	}
 	catch(const std::exception& ex)
     {
@@ -615,9 +907,11 @@ bool SonosPeer::load(BaseLib::Systems::ICentral* central)
 			return false;
 		}
 		initializeTypeString();
+		getDispatchPlan();
 		std::string entry;
 		loadConfig();
 		initializeCentralConfig();
+		resetVolatileVariables(dynamic_cast<SonosCentral*>(central));
 
 		serviceMessages.reset(new BaseLib::Systems::ServiceMessages(_bl, _peerID, _serialNumber, this));
 		serviceMessages->load();
@@ -672,127 +966,192 @@ void SonosPeer::saveVariables()
     }
 }
 
+std::shared_ptr<DispatchPlan> SonosPeer::getDispatchPlan()
+{
+	try
+	{
+		std::lock_guard<std::mutex> dispatchPlanGuard(_dispatchPlanMutex);
+		if(!_dispatchPlan || !_dispatchPlan->isFor(_rpcDevice)) _dispatchPlan = DispatchPlan::get(_rpcDevice);
+		return _dispatchPlan;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return std::shared_ptr<DispatchPlan>();
+}
+
 void SonosPeer::getValuesFromPacket(std::shared_ptr<SonosPacket> packet, std::vector<FrameValues>& frameValues)
 {
 	try
 	{
 		if(!_rpcDevice) return;
-		//equal_range returns all elements with "0" or an unknown element as argument
-		if(_rpcDevice->packetsByFunction2.find(packet->functionName()) == _rpcDevice->packetsByFunction2.end()) return;
-		std::pair<PacketsByFunction::iterator, PacketsByFunction::iterator> range = _rpcDevice->packetsByFunction2.equal_range(packet->functionName());
-		if(range.first == _rpcDevice->packetsByFunction2.end()) return;
-		PacketsByFunction::iterator i = range.first;
-		std::shared_ptr<std::unordered_map<std::string, std::string>> soapValues;
-		std::string field;
-		do
-		{
-			FrameValues currentFrameValues;
-			PPacket frame(i->second);
-			if(!frame) continue;
-			if(frame->direction != Packet::Direction::Enum::toCentral) continue;
-			int32_t channel = -1;
-			if(frame->channel > -1) channel = frame->channel;
-			currentFrameValues.frameID = frame->id;
-
-			for(JsonPayloads::iterator j = frame->jsonPayloads.begin(); j != frame->jsonPayloads.end(); ++j)
-			{
-				if(!(*j)->subkey.empty() && ((*j)->key == "CurrentTrackMetaData" || (*j)->key == "TrackMetaData"))
-				{
-					soapValues = packet->currentTrackMetadata();
-					if(!soapValues || soapValues->find((*j)->subkey) == soapValues->end()) continue;
-					field = (*j)->subkey;
-				}
-				else if(!(*j)->subkey.empty() && ((*j)->key == "r:NextTrackMetaData"))
-				{
-					soapValues = packet->nextTrackMetadata();
-					if(!soapValues || soapValues->find((*j)->subkey) == soapValues->end()) continue;
-					field = (*j)->subkey;
-				}
-				else if(!(*j)->subkey.empty() && ((*j)->key == "AVTransportURIMetaData"))
-				{
-					soapValues = packet->avTransportUriMetaData();
-					if(!soapValues || soapValues->find((*j)->subkey) == soapValues->end()) continue;
-					field = (*j)->subkey;
-				}
-				else if(!(*j)->subkey.empty() && ((*j)->key == "NextAVTransportURIMetaData"))
-				{
-					soapValues = packet->nextAvTransportUriMetaData();
-					if(!soapValues || soapValues->find((*j)->subkey) == soapValues->end()) continue;
-					field = (*j)->subkey;
-				}
-				else if(!(*j)->subkey.empty() && ((*j)->key == "r:EnqueuedTransportURIMetaData"))
-				{
-					soapValues = packet->currentTrackMetadata();
-					if(!soapValues || soapValues->find((*j)->subkey) == soapValues->end()) continue;
-					field = (*j)->subkey;
-				}
-				else
-				{
-					soapValues = packet->values();
-					if((!soapValues || soapValues->find((*j)->key) == soapValues->end()) && (!packet->browseResult() || packet->browseResult()->first != (*j)->key)) continue;
-					field = (*j)->key;
-				}
+		PDispatchPlan dispatchPlan = getDispatchPlan();
+		if(!dispatchPlan) return;
+		const DispatchPlan::Function* function = dispatchPlan->function(packet->functionName());
+		if(!function) return;
+
+		std::vector<FrameValues> planFrameValues(function->frameIds.size());
+		SonosPacket::PValueMap values = packet->values();
+		std::shared_ptr<std::pair<std::string, BaseLib::PVariable>> browseResult = packet->browseResult();
+		std::vector<std::pair<const std::vector<DispatchPlan::Entry>*, std::string_view>> receivedEntries;
+		receivedEntries.reserve(values->size() + 1);
+		for(SonosPacket::ValueMap::const_iterator i = values->begin(); i != values->end(); ++i)
+		{
+			auto entriesIterator = function->entriesByKey.find(i->first);
+			if(entriesIterator != function->entriesByKey.end()) receivedEntries.emplace_back(&entriesIterator->second, i->second);
+		}
+		if(browseResult)
+		{
+			auto entriesIterator = function->entriesByKey.find(browseResult->first);
+			if(entriesIterator != function->entriesByKey.end() && values->find(browseResult->first) == values->end()) receivedEntries.emplace_back(&entriesIterator->second, std::string_view());
+		}
 
-				for(std::vector<PParameter>::iterator k = frame->associatedVariables.begin(); k != frame->associatedVariables.end(); ++k)
+		for(auto& receivedEntry : receivedEntries)
+		{
+			for(const DispatchPlan::Entry& entry : *receivedEntry.first)
+			{
+				std::string_view value = receivedEntry.second;
+				if(entry.metadataType != SonosPacket::MetadataType::count && !packet->metadata(entry.metadataType).get(entry.subkey, value)) continue;
+
+				FrameValues& currentFrameValues = planFrameValues.at(entry.frameIndex);
+				for(const DispatchPlan::Target& target : entry.targets)
 				{
-					if((*k)->physical->groupId != (*j)->parameterId) continue;
-					currentFrameValues.parameterSetType = (*k)->parent()->type();
-					bool setValues = false;
-					if(currentFrameValues.paramsetChannels.empty()) //Fill paramsetChannels
+					currentFrameValues.parameterSetType = target.parameterSetType;
+					std::list<uint32_t> channels;
+					if(currentFrameValues.paramsetChannels.empty()) channels = target.channels;
+					else
 					{
-						int32_t startChannel = (channel < 0) ? 0 : channel;
-						int32_t endChannel;
-						//When fixedChannel is -2 (means '*') cycle through all channels
-						if(frame->channel == -2)
-						{
-							startChannel = 0;
-							endChannel = _rpcDevice->functions.rbegin()->first;
-						}
-						else endChannel = startChannel;
-						for(int32_t l = startChannel; l <= endChannel; l++)
+						for(std::list<uint32_t>::const_iterator l = currentFrameValues.paramsetChannels.begin(); l != currentFrameValues.paramsetChannels.end(); ++l)
 						{
-							Functions::iterator functionIterator = _rpcDevice->functions.find(l);
-							if(functionIterator == _rpcDevice->functions.end()) continue;
-							PParameterGroup parameterGroup = functionIterator->second->getParameterGroup(currentFrameValues.parameterSetType);
-							Parameters::iterator parameterIterator = parameterGroup->parameters.find((*k)->id);
-							if(parameterIterator == parameterGroup->parameters.end()) continue;
-							currentFrameValues.paramsetChannels.push_back(l);
-							currentFrameValues.values[(*k)->id].channels.push_back(l);
-							setValues = true;
+							if(std::find(target.channels.begin(), target.channels.end(), *l) != target.channels.end()) channels.push_back(*l);
 						}
 					}
-					else //Use paramsetChannels
+					if(channels.empty()) continue;
+
+					//Sonos sends unchanged values in every event. Drop them before doing any conversion. AV_TRANSPORT_URI is always processed.
+					//CURRENT_TRACK and TRANSPORT_STATE are always processed, too, as packetReceived() passes them to "playLocalFile()" even when
+					//they are unchanged.
+					size_t rawHash = 0;
+					if(!browseResult)
 					{
-						for(std::list<uint32_t>::const_iterator l = currentFrameValues.paramsetChannels.begin(); l != currentFrameValues.paramsetChannels.end(); ++l)
-						{
-							Functions::iterator functionIterator = _rpcDevice->functions.find(*l);
-							if(functionIterator == _rpcDevice->functions.end()) continue;
-							PParameterGroup parameterGroup = functionIterator->second->getParameterGroup(currentFrameValues.parameterSetType);
-							Parameters::iterator parameterIterator = parameterGroup->parameters.find((*k)->id);
-							if(parameterIterator == parameterGroup->parameters.end()) continue;
-							currentFrameValues.values[(*k)->id].channels.push_back(*l);
-							setValues = true;
-						}
+						rawHash = std::hash<std::string_view>()(value);
+						const std::string& id = target.parameter->id;
+						if(id != "AV_TRANSPORT_URI" && id != "CURRENT_TRACK" && id != "TRANSPORT_STATE" && rawValueUnchanged(channels, id, rawHash, value.size())) continue;
 					}
 
-					if(setValues)
+					if(currentFrameValues.paramsetChannels.empty()) currentFrameValues.paramsetChannels = target.channels;
+					FrameValue& frameValue = currentFrameValues.values[target.parameter->id];
+					frameValue.channels.insert(frameValue.channels.end(), channels.begin(), channels.end());
+					frameValue.hasRawFingerprint = !browseResult;
+					frameValue.rawHash = rawHash;
+					frameValue.rawSize = value.size();
+					convertReceivedValue(*_binaryEncoder, target.parameter, target.directConversion, value, browseResult ? browseResult->second : PVariable(), frameValue);
+				}
+			}
+		}
+
+		for(size_t i = 0; i < planFrameValues.size(); i++)
+		{
+			if(planFrameValues[i].values.empty()) continue;
+			planFrameValues[i].frameID = function->frameIds[i];
+			frameValues.push_back(std::move(planFrameValues[i]));
+		}
+	}
+	catch(const std::exception& ex)
+    {
+    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+bool SonosPeer::rawValueUnchanged(const std::list<uint32_t>& channels, const std::string& parameterId, size_t rawHash, size_t rawSize)
+{
+	try
+	{
+		std::lock_guard<std::mutex> rawValueFingerprintsGuard(_rawValueFingerprintsMutex);
+		for(uint32_t channel : channels)
+		{
+			auto channelIterator = _rawValueFingerprints.find(channel);
+			if(channelIterator == _rawValueFingerprints.end()) return false;
+			auto fingerprintIterator = channelIterator->second.find(parameterId);
+			if(fingerprintIterator == channelIterator->second.end()) return false;
+			RawValueFingerprint& fingerprint = fingerprintIterator->second;
+			if(fingerprint.rawHash != rawHash || fingerprint.rawSize != rawSize) return false;
+
+			auto valuesIterator = valuesCentral.find(channel);
+			if(valuesIterator == valuesCentral.end()) return false;
+			auto parameterIterator = valuesIterator->second.find(parameterId);
+			if(parameterIterator == valuesIterator->second.end()) return false;
+			std::vector<uint8_t>& storedData = parameterIterator->second.getBinaryDataReference();
+			if(storedData.size() != fingerprint.storedSize || std::hash<std::string_view>()(std::string_view((const char*)storedData.data(), storedData.size())) != fingerprint.storedHash) return false;
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+void SonosPeer::setRawValueFingerprint(uint32_t channel, const std::string& parameterId, const FrameValue& frameValue, const std::vector<uint8_t>& storedData)
+{
+	try
+	{
+		if(!frameValue.hasRawFingerprint) return;
+		std::lock_guard<std::mutex> rawValueFingerprintsGuard(_rawValueFingerprintsMutex);
+		RawValueFingerprint& fingerprint = _rawValueFingerprints[channel][parameterId];
+		fingerprint.rawHash = frameValue.rawHash;
+		fingerprint.rawSize = frameValue.rawSize;
+		fingerprint.storedHash = std::hash<std::string_view>()(std::string_view((const char*)storedData.data(), storedData.size()));
+		fingerprint.storedSize = storedData.size();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SonosPeer::convertReceivedValue(BaseLib::Rpc::RpcEncoder& binaryEncoder, const PParameter& parameter, bool directConversion, std::string_view value, const PVariable& browseResult, FrameValue& frameValue)
+{
+	try
+	{
+		frameValue.value.clear();
+		frameValue.variable.reset();
+		if(directConversion && (!browseResult || parameter->logical->type == ILogical::Type::Enum::tArray))
+		{
+			PVariable data;
+			if(browseResult) data = browseResult;
+			else
+			{
+				data = Variable::fromString(std::string(value), parameter->physical->type);
+				if(data->type == VariableType::tInteger)
+				{
+					//Same range check convertToPacket() does
+					LogicalInteger* logical = (LogicalInteger*)parameter->logical.get();
+					if(logical->specialValuesIntegerMap.find(data->integerValue) == logical->specialValuesIntegerMap.end())
 					{
-						//This is a little nasty and costs a lot of resources, but we need to run the data through the packet converter
-						std::vector<uint8_t> encodedData;
-						if(packet->browseResult()) _binaryEncoder->encodeResponse(packet->browseResult()->second, encodedData);
-						else _binaryEncoder->encodeResponse(Variable::fromString(soapValues->at(field), (*k)->physical->type), encodedData);
-						PVariable data = (*k)->convertFromPacket(encodedData, Role(), true);
-						(*k)->convertToPacket(data, Role(), currentFrameValues.values[(*k)->id].value);
+						if(data->integerValue > logical->maximumValue) data->integerValue = logical->maximumValue;
+						else if(data->integerValue < logical->minimumValue) data->integerValue = logical->minimumValue;
 					}
 				}
 			}
-			if(!currentFrameValues.values.empty()) frameValues.push_back(currentFrameValues);
-		} while(++i != range.second && i != _rpcDevice->packetsByFunction2.end());
+			binaryEncoder.encodeResponse(data, frameValue.value);
+			frameValue.variable = data;
+			return;
+		}
+
+		//This is a little nasty and costs a lot of resources, but we need to run the data through the packet converter
+		std::vector<uint8_t> encodedData;
+		if(browseResult) binaryEncoder.encodeResponse(browseResult, encodedData);
+		else binaryEncoder.encodeResponse(Variable::fromString(std::string(value), parameter->physical->type), encodedData);
+		PVariable data = parameter->convertFromPacket(encodedData, Role(), true);
+		parameter->convertToPacket(data, Role(), frameValue.value);
 	}
 	catch(const std::exception& ex)
-    {
-    	GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-    }
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
 }
 
 void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
@@ -803,8 +1162,20 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 		if(_disposing) return;
 		if(!_rpcDevice) return;
 		setLastPacketReceived();
+		if(packet->functionName() == "GetHouseholdIDResponse")
+		{
+			SonosPacket::PValueMap values = packet->values();
+			auto householdIdIterator = values->find("CurrentHouseholdID");
+			if(householdIdIterator != values->end())
+			{
+				std::lock_guard<std::mutex> householdIdGuard(_householdIdMutex);
+				_householdId = std::string(householdIdIterator->second);
+			}
+			return;
+		}
 		std::vector<FrameValues> frameValues;
 		getValuesFromPacket(packet, frameValues);
+		bool isPositionInfo = (packet->functionName() == "GetPositionInfoResponse");
 		std::map<uint32_t, std::shared_ptr<std::vector<std::string>>> valueKeys;
 		std::map<uint32_t, std::shared_ptr<std::vector<PVariable>>> rpcValues;
 
@@ -821,7 +1192,25 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 					if(std::find(i->second.channels.begin(), i->second.channels.end(), *j) == i->second.channels.end()) continue;
 
 					BaseLib::Systems::RpcConfigurationParameter& parameter = valuesCentral[*j][i->first];
-					if(parameter.equals(i->second.value) && i->first != "AV_TRANSPORT_URI") continue;
+					if((i->first == "CURRENT_TRACK" || i->first == "TRANSPORT_STATE") && parameter.rpcParameter)
+					{
+						//Wake up "playLocalFile()" waiting for the announcement to finish. This is done before unchanged values are skipped, as
+						//"playLocalFile()" clears the state before starting the announcement, e. g. while PLAYING is stored already.
+						PVariable value = i->second.variable ? i->second.variable : parameter.rpcParameter->convertFromPacket(i->second.value, parameter.mainRole(), true);
+						if(value)
+						{
+							std::lock_guard<std::mutex> transportGuard(_transportMutex);
+							if(i->first == "CURRENT_TRACK") _currentTrack = value->integerValue;
+							else _transportState = value->stringValue;
+							_transportChanges++;
+							_transportConditionVariable.notify_all();
+						}
+					}
+					if(parameter.equals(i->second.value) && i->first != "AV_TRANSPORT_URI")
+					{
+						setRawValueFingerprint(*j, i->first, i->second, parameter.getBinaryDataReference());
+						continue;
+					}
 
 					if(!valueKeys[*j] || !rpcValues[*j])
 					{
@@ -850,8 +1239,28 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 							}
 						}
 
-						PVariable value = parameter.rpcParameter->convertFromPacket(i->second.value, parameter.mainRole(), true);
-						if(i->first == "CURRENT_TRACK") _currentTrack = value->integerValue;
+						PVariable value;
+						if(i->second.variable)
+						{
+							//The variable is modified below, so only use it once.
+							value = i->second.variable;
+							i->second.variable.reset();
+						}
+						else value = parameter.rpcParameter->convertFromPacket(i->second.value, parameter.mainRole(), true);
+						if(!isPositionInfo)
+						{
+							//Resynchronize the playback position on AVTransport events
+							if(i->first == "TRANSPORT_STATE")
+							{
+								setPlaying(value->stringValue == "PLAYING");
+								_positionResyncRequested = true;
+							}
+							else if(i->first == "CURRENT_TRACK" || i->first == "CURRENT_TRACK_URI")
+							{
+								setPosition(0);
+								_positionResyncRequested = true;
+							}
+						}
 						if(i->first == "CURRENT_ALBUM_ART")
 						{
                             std::string artPath;
@@ -873,29 +1282,25 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 
 							BaseLib::Systems::RpcConfigurationParameter& parameter2 = valuesCentral[1]["CURRENT_TITLE"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_TITLE", emptyData);
+							saveVariableValue(*j, "CURRENT_TITLE", emptyData);
 							valueKeys[1]->push_back("CURRENT_TITLE");
 							rpcValues[1]->push_back(value);
 
 							parameter2 = valuesCentral[1]["CURRENT_ALBUM"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ALBUM", emptyData);
+							saveVariableValue(*j, "CURRENT_ALBUM", emptyData);
 							valueKeys[1]->push_back("CURRENT_ALBUM");
 							rpcValues[1]->push_back(value);
 
 							parameter2 = valuesCentral[1]["CURRENT_ARTIST"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ARTIST", emptyData);
+							saveVariableValue(*j, "CURRENT_ARTIST", emptyData);
 							valueKeys[1]->push_back("CURRENT_ARTIST");
 							rpcValues[1]->push_back(value);
 
 							parameter2 = valuesCentral[1]["CURRENT_ALBUM_ART"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ALBUM_ART", emptyData);
+							saveVariableValue(*j, "CURRENT_ALBUM_ART", emptyData);
 							valueKeys[1]->push_back("CURRENT_ALBUM_ART");
 							rpcValues[1]->push_back(value);
 						}
@@ -906,29 +1311,25 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 
 							BaseLib::Systems::RpcConfigurationParameter& parameter2 = valuesCentral[1]["NEXT_TITLE"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "NEXT_TITLE", emptyData);
+							saveVariableValue(*j, "NEXT_TITLE", emptyData);
 							valueKeys[1]->push_back("NEXT_TITLE");
 							rpcValues[1]->push_back(value);
 
 							parameter2 = valuesCentral[1]["NEXT_ALBUM"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "NEXT_ALBUM", emptyData);
+							saveVariableValue(*j, "NEXT_ALBUM", emptyData);
 							valueKeys[1]->push_back("NEXT_ALBUM");
 							rpcValues[1]->push_back(value);
 
 							parameter2 = valuesCentral[1]["NEXT_ARTIST"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "NEXT_ARTIST", emptyData);
+							saveVariableValue(*j, "NEXT_ARTIST", emptyData);
 							valueKeys[1]->push_back("NEXT_ARTIST");
 							rpcValues[1]->push_back(value);
 
 							parameter2 = valuesCentral[1]["NEXT_ALBUM_ART"];
 							parameter2.setBinaryData(emptyData);
-							if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-							else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "NEXT_ALBUM_ART", emptyData);
+							saveVariableValue(*j, "NEXT_ALBUM_ART", emptyData);
 							valueKeys[1]->push_back("NEXT_ALBUM_ART");
 							rpcValues[1]->push_back(value);
 						}
@@ -1011,8 +1412,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
                                         parameter2.rpcParameter->convertToPacket(isMaster, parameter2.mainRole(), parameterData);
                                         parameter2.setBinaryData(parameterData);
                                         auto bla = parameter2.getBinaryData();
-                                        if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, parameterData);
-                                        else saveParameter(0, ParameterGroup::Type::Enum::variables, 1, "IS_MASTER", parameterData);
+                                        saveVariableValue(1, "IS_MASTER", parameterData);
                                         valueKeys[1]->push_back("IS_MASTER");
                                         rpcValues[1]->push_back(isMaster);
 
@@ -1036,8 +1436,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
                                             std::vector<uint8_t> parameterData2;
                                             parameter3.rpcParameter->convertToPacket(masterId, parameter3.mainRole(), parameterData2);
                                             parameter3.setBinaryData(parameterData2);
-                                            if(parameter3.databaseId > 0) saveParameter(parameter3.databaseId, parameterData2);
-                                            else saveParameter(0, ParameterGroup::Type::Enum::variables, 1, "MASTER_ID", parameterData2);
+                                            saveVariableValue(1, "MASTER_ID", parameterData2);
                                             valueKeys[1]->push_back("MASTER_ID");
                                             rpcValues[1]->push_back(masterId);
                                         }
@@ -1058,8 +1457,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 									BaseLib::Systems::RpcConfigurationParameter& parameter3 = valuesCentral[1]["AV_TRANSPORT_TITLE"];
 									BaseLib::Systems::RpcConfigurationParameter& parameter2 = valuesCentral[1]["CURRENT_ALBUM"];
 									parameter2.setBinaryData(parameter3.getBinaryDataReference());
-									if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, parameter2.getBinaryDataReference());
-									else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ALBUM", parameter2.getBinaryDataReference());
+									saveVariableValue(*j, "CURRENT_ALBUM", parameter2.getBinaryDataReference());
 									valueKeys[1]->push_back("CURRENT_ALBUM");
 									rpcValues[1]->push_back(value);
 								}
@@ -1067,8 +1465,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 								{
 									BaseLib::Systems::RpcConfigurationParameter& parameter2 = valuesCentral[1]["CURRENT_ARTIST"];
 									parameter2.setBinaryData(emptyData);
-									if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-									else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ARTIST", emptyData);
+									saveVariableValue(*j, "CURRENT_ARTIST", emptyData);
 									valueKeys[1]->push_back("CURRENT_ARTIST");
 									rpcValues[1]->push_back(value);
 								}
@@ -1076,8 +1473,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 								{
 									BaseLib::Systems::RpcConfigurationParameter& parameter2 = valuesCentral[1]["CURRENT_ALBUM_ART"];
 									parameter2.setBinaryData(emptyData);
-									if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, emptyData);
-									else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ALBUM_ART", emptyData);
+									saveVariableValue(*j, "CURRENT_ALBUM_ART", emptyData);
 									valueKeys[1]->push_back("CURRENT_ALBUM_ART");
 									rpcValues[1]->push_back(value);
 								}
@@ -1086,8 +1482,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 									BaseLib::Systems::RpcConfigurationParameter& parameter3 = valuesCentral[1]["CURRENT_TRACK_STREAM_CONTENT"];
 									BaseLib::Systems::RpcConfigurationParameter& parameter2 = valuesCentral[1]["CURRENT_TITLE"];
 									parameter2.setBinaryData(parameter3.getBinaryDataReference());
-									if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, parameter2.getBinaryDataReference());
-									else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_TITLE", parameter2.getBinaryDataReference());
+									saveVariableValue(*j, "CURRENT_TITLE", parameter2.getBinaryDataReference());
 									valueKeys[1]->push_back("CURRENT_TITLE");
 									rpcValues[1]->push_back(value);
 								}
@@ -1105,8 +1500,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 										BaseLib::PVariable isStream(new BaseLib::Variable(_isStream));
 										parameter3.rpcParameter->convertToPacket(isStream, parameter3.mainRole(), parameterData);
 										parameter3.setBinaryData(parameterData);
-										if(parameter3.databaseId > 0) saveParameter(parameter3.databaseId, parameterData);
-										else saveParameter(0, ParameterGroup::Type::Enum::variables, 1, "IS_STREAM", parameterData);
+										saveVariableValue(1, "IS_STREAM", parameterData);
 										valueKeys[1]->push_back("IS_STREAM");
 										rpcValues[1]->push_back(isStream);
 									}
@@ -1124,8 +1518,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 									std::vector<uint8_t> binaryData;
 									parameter2.rpcParameter->convertToPacket(value, parameter2.mainRole(), binaryData);
 									parameter2.setBinaryData(binaryData);
-									if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, binaryData);
-									else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_TITLE", binaryData);
+									saveVariableValue(*j, "CURRENT_TITLE", binaryData);
 									valueKeys[1]->push_back("CURRENT_TITLE");
 									rpcValues[1]->push_back(value);
 								}
@@ -1138,8 +1531,7 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 									std::vector<uint8_t> binaryData;
 									parameter2.rpcParameter->convertToPacket(value, parameter2.mainRole(), binaryData);
 									parameter2.setBinaryData(binaryData);
-									if(parameter2.databaseId > 0) saveParameter(parameter2.databaseId, binaryData);
-									else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, "CURRENT_ALBUM", binaryData);
+									saveVariableValue(*j, "CURRENT_ALBUM", binaryData);
 									valueKeys[1]->push_back("CURRENT_ALBUM");
 									rpcValues[1]->push_back(value);
 								}
@@ -1149,8 +1541,8 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 						}
 
 						parameter.setBinaryData(i->second.value);
-						if(parameter.databaseId > 0) saveParameter(parameter.databaseId, i->second.value);
-						else saveParameter(0, ParameterGroup::Type::Enum::variables, *j, i->first, i->second.value);
+						setRawValueFingerprint(*j, i->first, i->second, i->second.value);
+						saveVariableValue(*j, i->first, i->second.value);
 						if(_bl->debugLevel >= 4) GD::out.printInfo("Info: " + i->first + " of peer " + std::to_string(_peerID) + " with serial number " + _serialNumber + ":" + std::to_string(*j) + " was set.");
 
 						valueKeys[*j]->push_back(i->first);
@@ -1160,6 +1552,8 @@ void SonosPeer::packetReceived(std::shared_ptr<SonosPacket> packet)
 			}
 		}
 
+		if(isPositionInfo) syncPosition();
+
 		if(!rpcValues.empty())
 		{
 			for(std::map<uint32_t, std::shared_ptr<std::vector<std::string>>>::iterator j = valueKeys.begin(); j != valueKeys.end(); ++j)
@@ -1184,44 +1578,114 @@ bool SonosPeer::sendSoapRequest(std::string& request, bool ignoreErrors)
 	try
 	{
 		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Sending SOAP request:\n" + request);
-		if(_httpClient)
+		std::shared_ptr<HttpClientPool> httpClientPool = _httpClientPool;
+		if(!httpClientPool) return false;
+		SoapClient::Response response = SoapClient::sendNow(*httpClientPool, request);
+		return processSoapResponse(request, response, ignoreErrors);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+bool SonosPeer::processSoapResponse(const std::string& request, SoapClient::Response& response, bool ignoreErrors)
+{
+	try
+	{
+		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: SOAP response (" + std::to_string(response.duration) + " ms):\n" + response.content);
+		if(response.success())
 		{
-			BaseLib::Http response;
-			try
-			{
-				_httpClient->sendRequest(request, response);
-				std::string stringResponse(response.getContent().data(), response.getContentSize());
-				if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: SOAP response:\n" + stringResponse);
-				if(response.getHeader().responseCode < 200 || response.getHeader().responseCode > 299)
-				{
-					if(ignoreErrors) return false;
-					GD::out.printWarning("Warning: Error in UPnP request: Response code was: " + std::to_string(response.getHeader().responseCode));
-					GD::out.printMessage("Request was: \n" + request);
-					//if(response.getHeader().responseCode == -1) serviceMessages->setUnreach(true, false);
-				}
-				else
-				{
-					std::shared_ptr<SonosPacket> responsePacket(new SonosPacket(stringResponse));
-					packetReceived(responsePacket);
-					serviceMessages->setUnreach(false, true);
-					return true;
-				}
-			}
-			catch(const BaseLib::HttpClientException& ex)
-			{
-				if(ignoreErrors) return false;
-				GD::out.printWarning("Warning: Error in UPnP request: " + std::string(ex.what()));
-				GD::out.printMessage("Request was: \n" + request);
-				if(ex.responseCode() == -1) serviceMessages->setUnreach(true, false);
-			}
-			catch(const std::exception& ex)
+			std::shared_ptr<SonosPacket> responsePacket(new SonosPacket(std::move(response.content)));
+			packetReceived(responsePacket);
+			serviceMessages->setUnreach(false, true);
+			return true;
+		}
+		if(ignoreErrors) return false;
+		if(response.error.empty()) GD::out.printWarning("Warning: Error in UPnP request: Response code was: " + std::to_string(response.responseCode));
+		else GD::out.printWarning("Warning: Error in UPnP request: " + response.error);
+		GD::out.printMessage("Request was: \n" + request);
+		if(!response.error.empty() && response.responseCode == -1) serviceMessages->setUnreach(true, false);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+bool SonosPeer::executeAsync(std::string functionName, std::function<void(bool success)> completion)
+{
+	try
+	{
+		UpnpFunctions::iterator functionEntry = _upnpFunctions.find(functionName);
+		if(functionEntry == _upnpFunctions.end())
+		{
+			GD::out.printError("Error: Tried to execute unknown function: " + functionName);
+			return false;
+		}
+		std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+		if(!central || !central->soapClient()) return false;
+		std::string soapRequest;
+		std::string headerSoapRequest = functionEntry->second.service() + '#' + functionName;
+		SonosPacket packet(_ip, functionEntry->second.path(), headerSoapRequest, functionEntry->second.service(), functionName, functionEntry->second.soapValues());
+		packet.getSoapRequest(soapRequest);
+		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Queueing SOAP request:\n" + soapRequest);
+		//The central outlives the SOAP client, so the raw pointer is safe.
+		SonosCentral* centralPointer = central.get();
+		uint64_t peerId = _peerID;
+		return central->soapClient()->send(_peerID, _httpClientPool, soapRequest, [centralPointer, peerId, soapRequest, completion](SoapClient::Response& response)
+		{
+			std::shared_ptr<SonosPeer> peer = centralPointer->getPeer(peerId);
+			if(!peer || peer->deleting) return;
+			bool success = peer->processSoapResponse(soapRequest, response, false);
+			if(completion) completion(success);
+		});
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+std::string SonosPeer::commandGroup(const std::string& functionName, const PSoapValues& soapValues)
+{
+	try
+	{
+		auto getSoapValue = [&](const std::string& name) -> std::string
+		{
+			if(!soapValues) return "";
+			for(auto& soapValue : *soapValues)
 			{
-				if(ignoreErrors) return false;
-				GD::out.printWarning("Warning: Error in UPnP request: " + std::string(ex.what()));
-				GD::out.printMessage("Request was: \n" + request);
-				serviceMessages->setUnreach(true, false);
+				if(soapValue.first == name) return soapValue.second;
 			}
-		}
+			return "";
+		};
+
+		if(functionName == "SetVolume" || functionName == "RampToVolume") return "volume:" + getSoapValue("Channel");
+		else if(functionName == "SetMute") return "mute:" + getSoapValue("Channel");
+		else if(functionName == "Seek") return "seek:" + getSoapValue("Unit");
+		else if(functionName == "SetPlayMode") return "playMode";
+		//Only the last transport command determines the resulting state.
+		else if(functionName == "Play" || functionName == "Pause" || functionName == "Stop") return "transport";
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return "";
+}
+
+bool SonosPeer::poll(std::string functionName, std::function<void(bool success)> completion)
+{
+	try
+	{
+		std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+		if(!central || !central->soapClient()) return false;
+		if(central->soapClient()->pending(_peerID) > 0) return false;
+		return executeAsync(functionName, completion);
 	}
 	catch(const std::exception& ex)
 	{
@@ -1462,12 +1926,12 @@ PVariable SonosPeer::getValueFromDevice(PParameter& parameter, int32_t channel,
 		SonosPacket packet(_ip, frame->metaString1, frame->function1, frame->metaString2, frame->function2, soapValues);
 		packet.getSoapRequest(soapRequest);
 		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Sending SOAP request:\n" + soapRequest);
-		if(_httpClient)
+		if(_httpClientPool)
 		{
 			BaseLib::Http response;
 			try
 			{
-				_httpClient->sendRequest(soapRequest, response);
+				_httpClientPool->sendRequest(soapRequest, response);
 				std::string stringResponse(response.getContent().data(), response.getContentSize());
 				if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: SOAP response:\n" + stringResponse);
 				if(response.getHeader().responseCode < 200 || response.getHeader().responseCode > 299)
@@ -1475,7 +1939,7 @@ PVariable SonosPeer::getValueFromDevice(PParameter& parameter, int32_t channel,
 					//if(response.getHeader().responseCode == -1) serviceMessages->setUnreach(true, false);
 					return Variable::createError(-100, "Error sending value to Sonos device: Response code was: " + std::to_string(response.getHeader().responseCode));
 				}
-				std::shared_ptr<SonosPacket> responsePacket(new SonosPacket(stringResponse));
+				std::shared_ptr<SonosPacket> responsePacket(new SonosPacket(std::move(stringResponse)));
 				packetReceived(responsePacket);
 				serviceMessages->setUnreach(false, true);
 			}
@@ -1601,7 +2065,18 @@ PVariable SonosPeer::getValue(BaseLib::PRpcClientInfo clientInfo, uint32_t chann
 				}
 			}
 		}
-		return Peer::getValue(clientInfo, channel, valueKey, requestFromDevice, asynchronous);
+		PVariable result = Peer::getValue(clientInfo, channel, valueKey, requestFromDevice, asynchronous);
+		if(channel == 1 && !requestFromDevice && valueKey == "CURRENT_TRACK_RELATIVE_TIME" && !result->errorStruct)
+		{
+			//The stored value is only updated on resynchronization, so return the interpolated position.
+			int64_t position = currentPosition();
+			if(position >= 0)
+			{
+				result->integerValue = position;
+				result->integerValue64 = position;
+			}
+		}
+		return result;
 	}
 	catch(const std::exception& ex)
     {
@@ -1873,47 +2348,74 @@ PVariable SonosPeer::setValue(BaseLib::PRpcClientInfo clientInfo, uint32_t chann
 				SonosPacket packet(_ip, frame->metaString1, frame->function1, frame->metaString2, frame->function2, soapValues);
 				packet.getSoapRequest(soapRequest);
 				if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Sending SOAP request:\n" + soapRequest);
-				if(_httpClient)
+				std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+				if(!central || !central->soapClient() || !_httpClientPool) return Variable::createError(-32500, "Peer is not initialized.");
+
+				//Commands are sent through the speaker's queue, so a newer value replaces an older one still waiting there. The deadline makes sure
+				//nothing is sent after the caller gave up.
+				int64_t deadline = BaseLib::HelperFunctions::getTime() + central->commandTimeout();
+				std::shared_ptr<std::promise<SoapClient::Response>> responsePromise;
+				std::future<SoapClient::Response> responseFuture;
+				if(wait)
+				{
+					responsePromise = std::make_shared<std::promise<SoapClient::Response>>();
+					responseFuture = responsePromise->get_future();
+				}
+				bool queued = central->soapClient()->send(_peerID, _httpClientPool, soapRequest, [soapRequest, responsePromise](const SoapClient::Response& response)
 				{
-					BaseLib::Http response;
-					try
+					if(GD::bl->debugLevel >= 5)
 					{
-						_httpClient->sendRequest(soapRequest, response);
-						std::string stringResponse(response.getContent().data(), response.getContentSize());
-						if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: SOAP response:\n" + stringResponse);
-						if(response.getHeader().responseCode < 200 || response.getHeader().responseCode > 299)
-						{
-							GD::out.printWarning("Warning: Error in UPnP request: Response code was: " + std::to_string(response.getHeader().responseCode));
-							GD::out.printMessage("Request was: \n" + soapRequest);
-							return Variable::createError(-100, "Error sending value to Sonos device: Response code was: " + std::to_string(response.getHeader().responseCode));
-						}
+						if(response.dropped()) GD::out.printDebug("Debug: SOAP request was " + response.dropReason + ":\n" + soapRequest);
+						else GD::out.printDebug("Debug: SOAP response (" + std::to_string(response.duration) + " ms):\n" + response.content);
 					}
-					catch(const BaseLib::HttpException& ex)
+					if(responsePromise)
 					{
-						GD::out.printWarning("Warning: Error in UPnP request: " + std::string(ex.what()));
-						GD::out.printMessage("Request was: \n" + soapRequest);
-						return Variable::createError(-100, "Error sending value to Sonos device: " + std::string(ex.what()));
+						responsePromise->set_value(response);
+						return;
 					}
-					catch(const BaseLib::HttpClientException& ex)
+					if(response.success() || response.dropped()) return;
+					if(response.error.empty()) GD::out.printWarning("Warning: Error in UPnP request: Response code was: " + std::to_string(response.responseCode));
+					else GD::out.printWarning("Warning: Error in UPnP request: " + response.error);
+					GD::out.printMessage("Request was: \n" + soapRequest);
+				}, commandGroup(frame->function2, soapValues), deadline);
+				if(!queued) return Variable::createError(-32500, "Peer is disposing.");
+
+				if(wait)
+				{
+					//Wait for a request sent right before the deadline, too.
+					if(responseFuture.wait_for(std::chrono::milliseconds(deadline - BaseLib::HelperFunctions::getTime() + _readTimeout)) != std::future_status::ready)
 					{
-						GD::out.printWarning("Warning: Error in UPnP request: " + std::string(ex.what()));
-						GD::out.printMessage("Request was: \n" + soapRequest);
-						return Variable::createError(-100, "Error sending value to Sonos device: " + std::string(ex.what()));
+						return Variable::createError(-100, "Error sending value to Sonos device: Timeout.");
 					}
-					catch(const std::exception& ex)
+					SoapClient::Response response = responseFuture.get();
+					//A newer value was set in the meantime, so this one is outdated.
+					if(response.dropReason == "superseded") return std::make_shared<Variable>(VariableType::tVoid);
+					if(response.dropped()) return Variable::createError(-100, "Error sending value to Sonos device: Request " + response.dropReason + ".");
+					if(!response.success())
 					{
-						GD::out.printWarning("Warning: Error in UPnP request: " + std::string(ex.what()));
+						if(response.error.empty())
+						{
+							GD::out.printWarning("Warning: Error in UPnP request: Response code was: " + std::to_string(response.responseCode));
+							GD::out.printMessage("Request was: \n" + soapRequest);
+							return Variable::createError(-100, "Error sending value to Sonos device: Response code was: " + std::to_string(response.responseCode));
+						}
+						GD::out.printWarning("Warning: Error in UPnP request: " + response.error);
 						GD::out.printMessage("Request was: \n" + soapRequest);
-						return Variable::createError(-100, "Error sending value to Sonos device: " + std::string(ex.what()));
+						return Variable::createError(-100, "Error sending value to Sonos device: " + response.error);
 					}
 				}
+
+				if(valueKey == "CURRENT_TRACK_RELATIVE_TIME")
+				{
+					setPosition(value->integerValue);
+					_positionResyncRequested = true;
+				}
 			}
 		}
 		else if(rpcParameter->physical->operationType != IPhysical::OperationType::Enum::store) return Variable::createError(-6, "Only interface types \"store\" and \"command\" are supported for this device family.");
 
 		parameter.setBinaryData(parameterData);
-		if(parameter.databaseId > 0) saveParameter(parameter.databaseId, parameterData);
-		else saveParameter(0, ParameterGroup::Type::Enum::variables, channel, valueKey, parameterData);
+		saveVariableValue(channel, valueKey, parameterData);
 
         std::string address(_serialNumber + ":" + std::to_string(channel));
         raiseEvent(clientInfo->initInterfaceId, _peerID, channel, valueKeys, values);
@@ -1968,7 +2470,11 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 			}
 		}
 
-		if(now)
+		//The variables needed to restore the playback afterwards are kept current by AVTransport and RenderingControl events. Only query them
+		//from the speaker when the subscriptions are not active.
+		bool snapshotFromEvents = now && _subscriptionManager->isActive("AVTransport") && _subscriptionManager->isActive("RenderingControl");
+		if(now && GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Peer " + std::to_string(_peerID) + ": Taking playback snapshot " + (snapshotFromEvents ? "from events." : "from the speaker."));
+		if(now && !snapshotFromEvents)
 		{
 			execute("GetPositionInfo");
 			if(serviceMessages->getUnreach())
@@ -2038,11 +2544,14 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 		}
 		if(now)
 		{
-			execute("GetMediaInfo");
-			if(serviceMessages->getUnreach())
+			if(!snapshotFromEvents)
 			{
-				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-				return;
+				execute("GetMediaInfo");
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
 			}
 
 			std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator parameterIterator = channelOneIterator->second.find("AV_TRANSPORT_URI");
@@ -2098,6 +2607,15 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 				if(variable) seekTimeState = variable->stringValue;
 			}
 
+			//Without a preceding GetPositionInfo, the stored position is only as recent as the last resynchronization, so use the interpolated one.
+			int64_t position = snapshotFromEvents ? currentPosition() : -1;
+			if(position >= 0)
+			{
+				std::ostringstream timeStream;
+				timeStream << (position / 3600) << ':' << std::setw(2) << std::setfill('0') << ((position % 3600) / 60) << ':' << std::setw(2) << std::setfill('0') << (position % 60);
+				seekTimeState = timeStream.str();
+			}
+
 			parameterIterator = channelOneIterator->second.find("TRANSPORT_STATE");
 			if(parameterIterator != channelOneIterator->second.end())
 			{
@@ -2147,54 +2665,83 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 			}
 		}
 
-		std::string playlistUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/' + silence10sPlaylistFilename;
-		bool result = execute("AddURIToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("EnqueuedURI", playlistUri), SoapValuePair("EnqueuedURIMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }), true);
-		if(!result)
+		//In direct mode the clip is set as transport URI, so the queue is left untouched. Files played later are always queued.
+		bool directMode = now && central->directAnnouncements();
+		bool batchQueueing = false;
+		if(!directMode)
 		{
-			GD::out.printWarning("Warning: Can't play file " + filename + ", because the speaker is not master.");
-			return;
-		}
-		if(serviceMessages->getUnreach())
-		{
-			GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-			return;
-		}
+			//Enqueue all tracks with one request. Speakers not supporting it get them one by one.
+			std::string baseUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/';
+			std::string playlistUris = baseUri + silence2sPlaylistFilename + ' ' + baseUri + playlistFilename + ' ' + baseUri + silence10sPlaylistFilename;
+			batchQueueing = execute("AddMultipleURIsToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("UpdateID", "0"), SoapValuePair("NumberOfURIs", "3"), SoapValuePair("EnqueuedURIs", playlistUris), SoapValuePair("EnqueuedURIsMetaData", "  "), SoapValuePair("ContainerURI", ""), SoapValuePair("ContainerMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }), true);
+			if(!batchQueueing)
+			{
+				std::string playlistUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/' + silence10sPlaylistFilename;
+				bool result = execute("AddURIToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("EnqueuedURI", playlistUri), SoapValuePair("EnqueuedURIMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }), true);
+				if(!result)
+				{
+					GD::out.printWarning("Warning: Can't play file " + filename + ", because the speaker is not master.");
+					return;
+				}
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
 
-		playlistUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/' + playlistFilename;
-		execute("AddURIToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("EnqueuedURI", playlistUri), SoapValuePair("EnqueuedURIMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }));
-		if(serviceMessages->getUnreach())
-		{
-			GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-			return;
-		}
+				playlistUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/' + playlistFilename;
+				execute("AddURIToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("EnqueuedURI", playlistUri), SoapValuePair("EnqueuedURIMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
 
-		playlistUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/' + silence2sPlaylistFilename;
-		execute("AddURIToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("EnqueuedURI", playlistUri), SoapValuePair("EnqueuedURIMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }));
-		if(serviceMessages->getUnreach())
-		{
-			GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-			return;
+				playlistUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort()) + '/' + silence2sPlaylistFilename;
+				execute("AddURIToQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("EnqueuedURI", playlistUri), SoapValuePair("EnqueuedURIMetaData", ""), SoapValuePair("DesiredFirstTrackNumberEnqueued", "1"), SoapValuePair("EnqueueAsNext", "1") }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
+			}
 		}
 
 		if(now)
 		{
-			execute("SetAVTransportURI", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("CurrentURI", "x-rincon-queue:" + rinconId + "#0"), SoapValuePair("CurrentURIMetaData", "") }));
-			if(serviceMessages->getUnreach())
 			{
-				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-				return;
+				std::lock_guard<std::mutex> transportGuard(_transportMutex);
+				_currentTrack = 1;
+				//Forget the state from before the announcement, so it isn't mistaken for the announcement's state.
+				_transportState.clear();
 			}
 
-			//std::unordered_map<uint32_t, std::unordered_map<std::string, BaseLib::Systems::RPCConfigurationParameter>>::iterator channelOneIterator = valuesCentral.find(1);
-			//std::unordered_map<std::string, BaseLib::Systems::RPCConfigurationParameter>::iterator parameterIterator = channelOneIterator->second.find("FIRST_TRACK_NUMBER_ENQUEUED");
-			/*if(parameterIterator != channelOneIterator->second.end())
+			if(directMode)
+			{
+				//Encode each path segment, so the slashes of files in subdirectories are kept.
+				std::string clipUri = "http://" + GD::physicalInterface->listenAddress() + ':' + std::to_string(GD::physicalInterface->listenPort());
+				std::vector<std::string> pathSegments = BaseLib::HelperFunctions::splitAll(filename, '/');
+				for(auto& pathSegment : pathSegments)
+				{
+					clipUri += '/' + BaseLib::Http::encodeURL(pathSegment);
+				}
+				if(!execute("SetAVTransportURI", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("CurrentURI", clipUri), SoapValuePair("CurrentURIMetaData", "") }), true))
+				{
+					GD::out.printWarning("Warning: Can't play file " + filename + ", because the speaker is not master.");
+					return;
+				}
+			}
+			else
 			{
-				PVariable variable = _binaryDecoder->decodeResponse(parameterIterator->second.data);
-				if(variable) trackNumber = variable->integerValue;
-			}*/
-			_currentTrack = 1;
+				execute("SetAVTransportURI", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("CurrentURI", "x-rincon-queue:" + rinconId + "#0"), SoapValuePair("CurrentURIMetaData", "") }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
 
-			execute("Seek", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Unit", "TRACK_NR"), SoapValuePair("Target", std::to_string(1)) }));
+				execute("Seek", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Unit", "TRACK_NR"), SoapValuePair("Target", std::to_string(1)) }));
+			}
 			if(serviceMessages->getUnreach())
 			{
 				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
@@ -2207,37 +2754,17 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 				return;
 			}
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+			//Completion is detected from AVTransport events. Polling is only a fallback for missed events.
+			auto isPlaying = [this]() { return _transportState == "PLAYING" || _transportState == "TRANSITIONING"; };
+			if(!waitForTransport(isPlaying, 2000)) execute("GetTransportInfo");
 
-			while(!serviceMessages->getUnreach() && (_currentTrack == 1 || _currentTrack == 2))
+			//In direct mode the transport stops at the end of the clip. In queue mode it continues with the silence after the clip.
+			auto isFinished = [this, isPlaying, directMode]() { return (!directMode && _currentTrack != 1 && _currentTrack != 2) || !isPlaying(); };
+			while(!serviceMessages->getUnreach() && !_shuttingDown && !deleting)
 			{
-				for(int32_t i = 0; i < 50; i++)
-				{
-					std::this_thread::sleep_for(std::chrono::milliseconds(100));
-					if(_currentTrack != 1 && _currentTrack != 2) break;
-				}
-
+				if(waitForTransport(isFinished, 5000)) break;
 				execute("GetPositionInfo");
-
-				std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator parameterIterator = channelOneIterator->second.find("CURRENT_TRACK");
-				if(parameterIterator != channelOneIterator->second.end())
-				{
-					std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
-					PVariable variable = _binaryDecoder->decodeResponse(parameterData);
-					if(!variable || (variable->integerValue != 1 && variable->integerValue != 2)) break;
-				}
-				else break;
-
 				execute("GetTransportInfo");
-
-				parameterIterator = channelOneIterator->second.find("TRANSPORT_STATE");
-				if(parameterIterator != channelOneIterator->second.end())
-				{
-					std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
-					PVariable variable = _binaryDecoder->decodeResponse(parameterData);
-					if(!variable || (variable->stringValue != "PLAYING" && variable->stringValue != "TRANSITIONING")) break;
-				}
-				else break;
 			}
 
 			//Pause often causes errors at this point
@@ -2254,28 +2781,46 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 				peer->setVolume(0);
 			}
 			if(muteState) execute("SetMute", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Channel", "Master"), SoapValuePair("DesiredMute", std::to_string((int32_t)muteState)) }));
-			execute("RemoveTrackFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("ObjectID", "Q:0/" + std::to_string(1)) }));
-			if(serviceMessages->getUnreach())
+			if(directMode && !currentTransportUri.empty())
 			{
-				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-				return;
+				//Restoring the URI restores the queue or stream that was playing before. When the speaker was idle, there is nothing to restore.
+				execute("SetAVTransportURI", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("CurrentURI", currentTransportUri), SoapValuePair("CurrentURIMetaData", currentTransportUriMetadata) }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
 			}
-			execute("RemoveTrackFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("ObjectID", "Q:0/" + std::to_string(1)) }));
-			if(serviceMessages->getUnreach())
+			bool removed = directMode || (batchQueueing && execute("RemoveTrackRangeFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("UpdateID", "0"), SoapValuePair("StartingIndex", "1"), SoapValuePair("NumberOfTracks", "3") }), true));
+			if(!removed)
 			{
-				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-				return;
+				execute("RemoveTrackFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("ObjectID", "Q:0/" + std::to_string(1)) }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
+				execute("RemoveTrackFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("ObjectID", "Q:0/" + std::to_string(1)) }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
+				execute("RemoveTrackFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("ObjectID", "Q:0/" + std::to_string(1)) }));
+				if(serviceMessages->getUnreach())
+				{
+					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
+					return;
+				}
 			}
-			execute("RemoveTrackFromQueue", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("ObjectID", "Q:0/" + std::to_string(1)) }));
-			if(serviceMessages->getUnreach())
+			//Streams can't be seeked, so this is only needed in direct mode when the queue was playing.
+			if(!directMode || !setQueue)
 			{
-				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
-				return;
+				if(trackNumberState > 0) execute("Seek", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Unit", "TRACK_NR"), SoapValuePair("Target", std::to_string(trackNumberState)) }), true);
+				if(!seekTimeState.empty()) execute("Seek", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Unit", "REL_TIME"), SoapValuePair("Target", seekTimeState) }), true);
 			}
-			if(trackNumberState > 0) execute("Seek", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Unit", "TRACK_NR"), SoapValuePair("Target", std::to_string(trackNumberState)) }), true);
-			if(!seekTimeState.empty()) execute("Seek", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Unit", "REL_TIME"), SoapValuePair("Target", seekTimeState) }), true);
 
-			if(setQueue) execute("SetAVTransportURI", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("CurrentURI", currentTransportUri), SoapValuePair("CurrentURIMetaData", currentTransportUriMetadata) }));
+			if(setQueue && !directMode && !currentTransportUri.empty()) execute("SetAVTransportURI", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("CurrentURI", currentTransportUri), SoapValuePair("CurrentURIMetaData", currentTransportUriMetadata) }));
 			if(serviceMessages->getUnreach())
 			{
 				GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
@@ -2285,27 +2830,23 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
 			if(transportState == "PLAYING")
 			{
 				GD::out.printInfo("Info (peer " + std::to_string(_peerID) + "): Resuming playback, because TRANSPORT_STATE was PLAYING.");
-				if(setQueue) execute("Play", true);
+				//Setting the transport URI stops playback.
+				if(setQueue || directMode) execute("Play", true);
 				if(serviceMessages->getUnreach())
 				{
 					GD::out.printWarning("Warning: Not playing file " + filename + ", because a speaker is unreachable.");
 					return;
 				}
 
-				for(int32_t i = 0; i < 10; i++)
+				//Give the speaker time to report the new state, then wait until it finished buffering.
+				uint64_t transportChanges = 0;
 				{
-					std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-
-					std::unordered_map<std::string, BaseLib::Systems::RpcConfigurationParameter>::iterator parameterIterator = channelOneIterator->second.find("TRANSPORT_STATE");
-					if(parameterIterator != channelOneIterator->second.end())
-					{
-						std::vector<uint8_t> parameterData = parameterIterator->second.getBinaryData();
-						PVariable variable = _binaryDecoder->decodeResponse(parameterData);
-						if(!variable || (variable->stringValue != "TRANSITIONING")) break;
-					}
+					std::lock_guard<std::mutex> transportGuard(_transportMutex);
+					transportChanges = _transportChanges;
 				}
+				waitForTransport([&]() { return _transportChanges != transportChanges; }, 1000);
+				waitForTransport([this]() { return _transportState != "TRANSITIONING"; }, 9000);
 
-				std::this_thread::sleep_for(std::chrono::milliseconds(500));
 				execute("RampToVolume", PSoapValues(new SoapValues{ SoapValuePair("InstanceID", "0"), SoapValuePair("Channel", "Master"), SoapValuePair("RampType", "AUTOPLAY_RAMP_TYPE"), SoapValuePair("DesiredVolume", std::to_string(volumeState)), SoapValuePair("ResetVolumeAfter", "false"), SoapValuePair("ProgramURI", "") }), true);
 				if(serviceMessages->getUnreach())
 				{
@@ -2340,6 +2881,20 @@ void SonosPeer::playLocalFile(std::string filename, bool now, bool unmute, int32
     }
 }
 
+bool SonosPeer::waitForTransport(const std::function<bool()>& predicate, int64_t timeout)
+{
+	try
+	{
+		std::unique_lock<std::mutex> transportGuard(_transportMutex);
+		return _transportConditionVariable.wait_for(transportGuard, std::chrono::milliseconds(timeout), [&]() { return predicate() || _shuttingDown || deleting; }) && predicate();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
 bool SonosPeer::setHomegearValue(uint32_t channel, std::string valueKey, PVariable value)
 {
 	try
@@ -2425,6 +2980,23 @@ bool SonosPeer::setHomegearValue(uint32_t channel, std::string valueKey, PVariab
 			std::string audioPath = GD::bl->settings.tempPath() + "sonos/";
 			std::string filename;
 			BaseLib::HelperFunctions::stringReplace(value->stringValue, "\"", "");
+
+			//Repeated texts are played from the cache without running the TTS program.
+			std::shared_ptr<SonosCentral> central = std::dynamic_pointer_cast<SonosCentral>(getCentral());
+			TtsCache* ttsCache = (central && central->ttsCache() && central->ttsCache()->enabled()) ? central->ttsCache() : nullptr;
+			std::string cacheKey;
+			if(ttsCache)
+			{
+				cacheKey = TtsCache::getKey(ttsProgram, language, voice, engine, value->stringValue);
+				filename = ttsCache->get(cacheKey);
+				if(!filename.empty())
+				{
+					if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Playing TTS audio file from cache: " + filename);
+					playLocalFile(filename, true, unmute, volume);
+					return true;
+				}
+			}
+
 			std::string execPath = ttsProgram + ' ' + language + ' ' + voice + " \"" + value->stringValue + "\"" + (!engine.empty() ? " " + engine : "");
             auto exitCode = BaseLib::ProcessManager::exec(execPath, _bl->fileDescriptorManager.getMax(), filename);
 			if(exitCode != 0)
@@ -2443,7 +3015,12 @@ bool SonosPeer::setHomegearValue(uint32_t channel, std::string valueKey, PVariab
 				GD::out.printError("Error: Error executing program to generate TTS audio file. Output needs to be the full path to the TTS audio file and the file needs to be within \"" + audioPath + "\". Returned path was: \"" + filename + "\"");
 				return true;
 			}
-			filename = filename.substr(audioPath.size());
+			if(ttsCache)
+			{
+				std::string cachedFilename = ttsCache->put(cacheKey, filename);
+				filename = cachedFilename.empty() ? filename.substr(audioPath.size()) : cachedFilename;
+			}
+			else filename = filename.substr(audioPath.size());
 
 			playLocalFile(filename, true, unmute, volume);
 
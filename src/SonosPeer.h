@@ -30,9 +30,13 @@
 #ifndef SONOSPEER_H_
 #define SONOSPEER_H_
 
+#include "SoapClient.h"
+
 #include <homegear-base/BaseLib.h>
 
+#include <condition_variable>
 #include <list>
+#include <unordered_set>
 
 using namespace BaseLib;
 using namespace BaseLib::DeviceDescription;
@@ -41,12 +45,37 @@ namespace Sonos
 {
 class SonosCentral;
 class SonosPacket;
+class DispatchPlan;
+class SubscriptionManager;
+class HttpClientPool;
+
+/**
+ * Periodic work of a peer. The central schedules each task by its deadline.
+ */
+enum class PeerTask : int32_t
+{
+	positionInfo,
+	mediaInfo,
+	subscriptions
+};
 
 class FrameValue
 {
 public:
 	std::list<uint32_t> channels;
 	std::vector<uint8_t> value;
+
+	/**
+	 * Set when the value was converted directly. Saves converting "value" back in packetReceived().
+	 */
+	PVariable variable;
+
+	/**
+	 * Hash and size of the raw value the binary value was created from. Only valid when "hasRawFingerprint" is set.
+	 */
+	bool hasRawFingerprint = false;
+	size_t rawHash = 0;
+	size_t rawSize = 0;
 };
 
 class FrameValues
@@ -66,6 +95,12 @@ public:
 	virtual ~SonosPeer();
 	void init();
 
+	/**
+	 * Converts a received value to the binary value stored for the parameter. With "directConversion" the value is parsed and encoded once and the
+	 * resulting variable is kept in "frameValue". Otherwise it is run through the parameter's casts.
+	 */
+	static void convertReceivedValue(BaseLib::Rpc::RpcEncoder& binaryEncoder, const PParameter& parameter, bool directConversion, std::string_view value, const PVariable& browseResult, FrameValue& frameValue);
+
 	//Features
 	virtual bool wireless() { return false; }
 	//End features
@@ -79,7 +114,25 @@ public:
 
 	virtual void setRoomName(std::string value, bool broadCastEvent);
 
-	void worker();
+	/**
+	 * Runs a periodic task.
+	 *
+	 * @return The time in milliseconds until the task should run again or -1 if it shouldn't run again, because the peer is shut down or deleted.
+	 */
+	int64_t runTask(PeerTask task);
+
+	/**
+	 * Cancels all event subscriptions of the speaker.
+	 */
+	void unsubscribe();
+
+	/**
+	 * Household-wide services are only subscribed through one elected speaker per household. Their events are passed to all peers of the
+	 * household.
+	 */
+	static bool isHouseholdService(const std::string& service);
+	std::string getHouseholdId();
+	bool isReachable() { return !serviceMessages->getUnreach(); }
 	virtual std::string handleCliCommand(std::string command);
 
 	virtual bool load(BaseLib::Systems::ICentral* central);
@@ -98,6 +151,11 @@ public:
 
     void packetReceived(std::shared_ptr<SonosPacket> packet);
 
+    /**
+     * Writes a variable to the database. Called by the central's write buffer.
+     */
+    void writeVariable(uint32_t channel, const std::string& key, std::vector<uint8_t>& data);
+
     std::string printConfig();
 
     /**
@@ -134,17 +192,22 @@ protected:
 	};
 
     std::atomic_bool _shuttingDown;
-    std::atomic_bool _getOneMorePositionInfo;
 	std::atomic_bool _isMaster;
     std::atomic_bool _isStream;
 	std::shared_ptr<BaseLib::Rpc::RpcEncoder> _binaryEncoder;
 	std::shared_ptr<BaseLib::Rpc::RpcDecoder> _binaryDecoder;
-	std::shared_ptr<BaseLib::HttpClient> _httpClient;
+	std::shared_ptr<HttpClientPool> _httpClientPool;
+	int32_t _readTimeout = 10000;
+	std::mutex _transportMutex;
+	std::condition_variable _transportConditionVariable;
 	int32_t _currentTrack = 0;
+	std::string _transportState;
+
+	/**
+	 * Incremented on every change of "_currentTrack" or "_transportState".
+	 */
+	uint64_t _transportChanges = 0;
 	int32_t _currentVolume = 0;
-	int32_t _lastAvTransportSubscription = 0;
-	int32_t _lastPositionInfo = 0;
-	int32_t _lastAvTransportInfo = 0;
 	std::timed_mutex _playLocalFileMutex;
 
 	typedef std::map<std::string, UpnpFunctionEntry> UpnpFunctions;
@@ -153,12 +216,88 @@ protected:
 	typedef std::shared_ptr<std::vector<std::pair<std::string, std::string>>> PSoapValues;
 	typedef std::pair<std::string, std::string> SoapValuePair;
 	UpnpFunctions _upnpFunctions;
+	std::mutex _dispatchPlanMutex;
+	std::shared_ptr<DispatchPlan> _dispatchPlan;
+
+	/**
+	 * Fingerprint of the last raw value received for a parameter together with a fingerprint of the binary value stored for it. The stored
+	 * fingerprint makes sure the raw fingerprint is ignored, when the parameter was changed in another way in the meantime.
+	 */
+	struct RawValueFingerprint
+	{
+		size_t rawHash = 0;
+		size_t rawSize = 0;
+		size_t storedHash = 0;
+		size_t storedSize = 0;
+	};
+	std::mutex _rawValueFingerprintsMutex;
+	std::unordered_map<uint32_t, std::unordered_map<std::string, RawValueFingerprint>> _rawValueFingerprints;
+
+	/**
+	 * Last known playback position. While playing, the current position is interpolated from it, so it isn't necessary to poll the speaker.
+	 * "syncTime" is a monotonic timestamp in milliseconds.
+	 */
+	struct PlaybackPosition
+	{
+		bool valid = false;
+		bool playing = false;
+		int64_t relativeTime = 0;
+		int64_t duration = 0;
+		int64_t syncTime = 0;
+	};
+	std::mutex _positionMutex;
+	PlaybackPosition _position;
+	std::atomic_bool _positionResyncRequested{true};
+
+	std::unique_ptr<SubscriptionManager> _subscriptionManager;
+	std::unique_ptr<SubscriptionManager> _householdSubscriptionManager;
+	std::mutex _householdIdMutex;
+	std::string _householdId;
 
 	virtual void loadVariables(BaseLib::Systems::ICentral* central, std::shared_ptr<BaseLib::Database::DataTable>& rows);
     virtual void saveVariables();
 
 	virtual std::shared_ptr<BaseLib::Systems::ICentral> getCentral();
+	/**
+	 * Saves a variable through the central's write buffer or directly when buffering is disabled. Volatile variables are not saved.
+	 */
+	void saveVariableValue(uint32_t channel, const std::string& key, std::vector<uint8_t>& data);
+
+	/**
+	 * Resets volatile variables to their default values. Values stored before a variable became volatile are never updated again and would be stale.
+	 */
+	void resetVolatileVariables(SonosCentral* central);
+
+	std::shared_ptr<DispatchPlan> getDispatchPlan();
+	void updatePositionInfo();
+	static int64_t monotonicTime();
+
+	/**
+	 * Returns the interpolated playback position in seconds or -1 if it is unknown.
+	 */
+	int64_t currentPosition();
+
+	/**
+	 * Rebases the playback position on the values received with the last GetPositionInfo response.
+	 */
+	void syncPosition();
+	void setPosition(int64_t relativeTime);
+	void setPlaying(bool playing);
+	int64_t renewSubscriptions();
+
+	/**
+	 * Creates the connection pool for the current IP address using the family settings.
+	 */
+	void createHttpClientPool();
+	void updateHouseholdId();
+
+	/**
+	 * @return Returns the lower case names of the services to subscribe to.
+	 */
+	std::unordered_set<std::string> getSubscribedServices();
 	void getValuesFromPacket(std::shared_ptr<SonosPacket> packet, std::vector<FrameValues>& frameValue);
+	bool rawValueUnchanged(const std::list<uint32_t>& channels, const std::string& parameterId, size_t rawHash, size_t rawSize);
+	void setRawValueFingerprint(uint32_t channel, const std::string& parameterId, const FrameValue& frameValue, const std::vector<uint8_t>& storedData);
 	bool setHomegearValue(uint32_t channel, std::string valueKey, PVariable value);
 
 	/**
@@ -176,8 +315,43 @@ protected:
 
 	bool sendSoapRequest(std::string& request, bool ignoreErrors = false);
 
+	/**
+	 * Queues a request on the central's SOAP client and returns immediately. The response is processed like the one of "execute()".
+	 *
+	 * @param completion Called with true when the request succeeded. Can be empty.
+	 * @return Returns false when the request could not be queued.
+	 */
+	bool executeAsync(std::string functionName, std::function<void(bool success)> completion = std::function<void(bool success)>());
+
+	/**
+	 * Like "executeAsync()", but skips the request while other requests to the speaker are still pending, so polls don't pile up when the
+	 * speaker is slow.
+	 */
+	bool poll(std::string functionName, std::function<void(bool success)> completion = std::function<void(bool success)>());
+
+	/**
+	 * Processes the response to a SOAP request. The content of a successful response is moved into the created packet.
+	 *
+	 * @return Returns true when the request succeeded.
+	 */
+	bool processSoapResponse(const std::string& request, SoapClient::Response& response, bool ignoreErrors);
+
+	/**
+	 * Returns the group of idempotent commands a SOAP function belongs to. Queued commands of the same group replace each other, e. g. only
+	 * the latest of several queued "SetVolume" requests is sent. Returns an empty string for commands that must not be coalesced.
+	 */
+	static std::string commandGroup(const std::string& functionName, const PSoapValues& soapValues);
+
 	void playLocalFile(std::string filename, bool now, bool unmute, int32_t volume);
 
+	/**
+	 * Waits until "predicate" returns true. The predicate is called with "_transportMutex" locked whenever the current track or the
+	 * transport state changes.
+	 *
+	 * @return Returns false on timeout or when the peer is shutting down.
+	 */
+	bool waitForTransport(const std::function<bool()>& predicate, int64_t timeout);
+
 	PVariable playBrowsableContent(std::string& title, std::string browseId, std::string listVariable);
 
     PVariable streamLocalInput(PRpcClientInfo clientInfo, bool wait);
@@ -0,0 +1,366 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "SubscriptionManager.h"
+#include "GD.h"
+
+namespace Sonos
+{
+
+SubscriptionManager::SubscriptionManager(const std::vector<std::string>& services, Listener listener) : _listener(std::move(listener))
+{
+	_subscriptions.reserve(services.size());
+	for(auto& service : services)
+	{
+		Subscription subscription;
+		subscription.service = service;
+		_subscriptions.push_back(std::move(subscription));
+	}
+}
+
+SubscriptionManager::UpdateResult SubscriptionManager::update(uint64_t peerId, HttpClientPool& httpClientPool, const std::string& host, const std::string& callbackUrl)
+{
+	UpdateResult result;
+	try
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		_peerId = peerId;
+		if(callbackUrl != _callbackUrl)
+		{
+			//Events for the existing subscriptions are sent to the old address.
+			clear();
+			_callbackUrl = callbackUrl;
+		}
+		int64_t now = BaseLib::HelperFunctions::getTime();
+		for(auto& subscription : _subscriptions)
+		{
+			if(!subscription.enabled)
+			{
+				if(!subscription.sid.empty())
+				{
+					if(subscription.expiry > now && !result.unreachable)
+					{
+						std::string request = "UNSUBSCRIBE " + subscription.service + " HTTP/1.1\r\nHOST: " + host + "\r\nSID: " + subscription.sid + "\r\nContent-Length: 0\r\n\r\n";
+						BaseLib::Http response;
+						if(sendRequest(httpClientPool, request, response) == -1) result.unreachable = true;
+						else GD::out.printInfo("Info: Unsubscribed from " + subscription.service + " of peer " + std::to_string(_peerId) + ".");
+					}
+					setSid(subscription, "");
+					subscription.expiry = 0;
+				}
+				continue;
+			}
+			if(subscription.nextUpdate > now) continue;
+			if(result.unreachable)
+			{
+				//Don't wait for the timeout of every single request.
+				subscription.nextUpdate = now + _retryInterval;
+				continue;
+			}
+
+			int32_t responseCode = 0;
+			if(!subscription.sid.empty() && subscription.expiry > now)
+			{
+				responseCode = renew(httpClientPool, host, subscription);
+				if(responseCode == 412)
+				{
+					GD::out.printInfo("Info: Subscription " + subscription.sid + " to " + subscription.service + " of peer " + std::to_string(_peerId) + " is unknown to the speaker. Subscribing again.");
+					setSid(subscription, "");
+					responseCode = subscribe(httpClientPool, host, callbackUrl, subscription);
+				}
+			}
+			else
+			{
+				setSid(subscription, "");
+				responseCode = subscribe(httpClientPool, host, callbackUrl, subscription);
+			}
+
+			if(responseCode == -1)
+			{
+				result.unreachable = true;
+				subscription.nextUpdate = now + _retryInterval;
+				continue;
+			}
+			result.responded = true;
+			if(responseCode < 200 || responseCode > 299) subscription.nextUpdate = now + _retryInterval;
+		}
+
+		int64_t nextUpdate = now + _retryInterval;
+		for(auto& subscription : _subscriptions)
+		{
+			if(subscription.enabled && subscription.nextUpdate < nextUpdate) nextUpdate = subscription.nextUpdate;
+		}
+		result.nextUpdate = nextUpdate > now ? nextUpdate - now : 0;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		result.nextUpdate = _retryInterval;
+	}
+	return result;
+}
+
+void SubscriptionManager::unsubscribeAll(uint64_t peerId, HttpClientPool& httpClientPool, const std::string& host)
+{
+	try
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		_peerId = peerId;
+		int64_t now = BaseLib::HelperFunctions::getTime();
+		for(auto& subscription : _subscriptions)
+		{
+			if(subscription.sid.empty() || subscription.expiry <= now) continue;
+			std::string request = "UNSUBSCRIBE " + subscription.service + " HTTP/1.1\r\nHOST: " + host + "\r\nSID: " + subscription.sid + "\r\nContent-Length: 0\r\n\r\n";
+			BaseLib::Http response;
+			int32_t responseCode = sendRequest(httpClientPool, request, response);
+			if(responseCode == -1) break;
+			if(responseCode < 200 || responseCode > 299) GD::out.printDebug("Debug: UNSUBSCRIBE from " + subscription.service + " of peer " + std::to_string(_peerId) + " returned response code " + std::to_string(responseCode) + ".");
+		}
+		//Subscriptions that couldn't be cancelled because the speaker became unreachable expire on their own.
+		clear();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SubscriptionManager::setEnabledServices(const std::unordered_set<std::string>& serviceNames)
+{
+	try
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		for(auto& subscription : _subscriptions)
+		{
+			subscription.enabled = serviceNames.find(BaseLib::HelperFunctions::toLower(serviceName(subscription.service))) != serviceNames.end();
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+std::string SubscriptionManager::serviceName(const std::string& service)
+{
+	std::string name = service;
+	if(name.size() > 6 && name.compare(name.size() - 6, 6, "/Event") == 0) name.resize(name.size() - 6);
+	auto position = name.find_last_of('/');
+	return position == std::string::npos ? name : name.substr(position + 1);
+}
+
+void SubscriptionManager::reset()
+{
+	try
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		clear();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void SubscriptionManager::clear()
+{
+	for(auto& subscription : _subscriptions)
+	{
+		setSid(subscription, "");
+		subscription.expiry = 0;
+		subscription.nextUpdate = 0;
+	}
+}
+
+size_t SubscriptionManager::activeCount()
+{
+	try
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		int64_t now = BaseLib::HelperFunctions::getTime();
+		size_t count = 0;
+		for(auto& subscription : _subscriptions)
+		{
+			if(subscription.enabled && !subscription.sid.empty() && subscription.expiry > now) count++;
+		}
+		return count;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return 0;
+}
+
+bool SubscriptionManager::isActive(const std::string& name)
+{
+	try
+	{
+		std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+		int64_t now = BaseLib::HelperFunctions::getTime();
+		for(auto& subscription : _subscriptions)
+		{
+			if(serviceName(subscription.service) != name) continue;
+			return subscription.enabled && !subscription.sid.empty() && subscription.expiry > now;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+int32_t SubscriptionManager::sendRequest(HttpClientPool& httpClientPool, const std::string& request, BaseLib::Http& response)
+{
+	try
+	{
+		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Sending GENA request:\n" + request);
+		httpClientPool.sendRequest(request, response, true);
+		return response.getHeader().responseCode;
+	}
+	catch(const BaseLib::HttpClientException& ex)
+	{
+		GD::out.printWarning("Warning: Error sending GENA request to peer " + std::to_string(_peerId) + ": " + ex.what());
+		return ex.responseCode();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printWarning("Warning: Error sending GENA request to peer " + std::to_string(_peerId) + ": " + ex.what());
+	}
+	return -1;
+}
+
+int32_t SubscriptionManager::subscribe(HttpClientPool& httpClientPool, const std::string& host, const std::string& callbackUrl, Subscription& subscription)
+{
+	try
+	{
+		std::string request = "SUBSCRIBE " + subscription.service + " HTTP/1.1\r\nHOST: " + host + "\r\nCALLBACK: <" + callbackUrl + ">\r\nNT: upnp:event\r\nTIMEOUT: Second-" + std::to_string(_requestedTimeout) + "\r\nContent-Length: 0\r\n\r\n";
+		BaseLib::Http response;
+		int32_t responseCode = sendRequest(httpClientPool, request, response);
+		if(responseCode < 200 || responseCode > 299)
+		{
+			if(responseCode != -1) GD::out.printWarning("Warning: Error calling SUBSCRIBE on " + subscription.service + " of peer " + std::to_string(_peerId) + ": Response code was: " + std::to_string(responseCode));
+			return responseCode;
+		}
+		if(!applyResponse(response, subscription))
+		{
+			GD::out.printWarning("Warning: Response to SUBSCRIBE on " + subscription.service + " of peer " + std::to_string(_peerId) + " contains no SID.");
+			return 500;
+		}
+		GD::out.printInfo("Info: Subscribed to " + subscription.service + " of peer " + std::to_string(_peerId) + " (SID " + subscription.sid + ", timeout " + std::to_string(subscription.timeout) + " s).");
+		return responseCode;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return -1;
+}
+
+int32_t SubscriptionManager::renew(HttpClientPool& httpClientPool, const std::string& host, Subscription& subscription)
+{
+	try
+	{
+		std::string request = "SUBSCRIBE " + subscription.service + " HTTP/1.1\r\nHOST: " + host + "\r\nSID: " + subscription.sid + "\r\nTIMEOUT: Second-" + std::to_string(_requestedTimeout) + "\r\nContent-Length: 0\r\n\r\n";
+		BaseLib::Http response;
+		int32_t responseCode = sendRequest(httpClientPool, request, response);
+		if(responseCode < 200 || responseCode > 299)
+		{
+			if(responseCode != -1 && responseCode != 412) GD::out.printWarning("Warning: Error renewing subscription to " + subscription.service + " of peer " + std::to_string(_peerId) + ": Response code was: " + std::to_string(responseCode));
+			return responseCode;
+		}
+		applyResponse(response, subscription); //The SID is optional in renewal responses of some firmware versions, so the old one is kept then
+		if(GD::bl->debugLevel >= 5) GD::out.printDebug("Debug: Renewed subscription " + subscription.sid + " to " + subscription.service + " of peer " + std::to_string(_peerId) + ".");
+		return responseCode;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return -1;
+}
+
+bool SubscriptionManager::applyResponse(BaseLib::Http& response, Subscription& subscription)
+{
+	try
+	{
+		auto& fields = response.getHeader().fields;
+
+		int32_t timeout = _requestedTimeout;
+		auto timeoutIterator = fields.find("timeout");
+		if(timeoutIterator != fields.end())
+		{
+			std::string timeoutString = BaseLib::HelperFunctions::toLower(timeoutIterator->second);
+			BaseLib::HelperFunctions::trim(timeoutString);
+			if(timeoutString.compare(0, 7, "second-") == 0)
+			{
+				int32_t grantedTimeout = BaseLib::Math::getNumber(timeoutString.substr(7));
+				if(grantedTimeout > 0) timeout = grantedTimeout;
+			}
+		}
+
+		int64_t now = BaseLib::HelperFunctions::getTime();
+		subscription.timeout = timeout;
+		subscription.expiry = now + (int64_t)timeout * 1000;
+		//Renew a minute before expiry, but not later than after three quarters of the timeout.
+		int64_t margin = std::min((int64_t)60000, (int64_t)timeout * 250);
+		subscription.nextUpdate = subscription.expiry - margin;
+
+		auto sidIterator = fields.find("sid");
+		if(sidIterator == fields.end()) return false;
+		std::string sid = sidIterator->second;
+		BaseLib::HelperFunctions::trim(sid);
+		if(sid.empty()) return false;
+		setSid(subscription, sid);
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return false;
+}
+
+void SubscriptionManager::setSid(Subscription& subscription, const std::string& sid)
+{
+	try
+	{
+		if(subscription.sid == sid) return;
+		if(!subscription.sid.empty() && _listener) _listener(subscription.sid, subscription.service, false);
+		subscription.sid = sid;
+		if(!subscription.sid.empty() && _listener) _listener(subscription.sid, subscription.service, true);
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+}
@@ -0,0 +1,177 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef SUBSCRIPTIONMANAGER_H_
+#define SUBSCRIPTIONMANAGER_H_
+
+#include "HttpClientPool.h"
+
+#include <homegear-base/BaseLib.h>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace Sonos
+{
+
+/**
+ * Manages the GENA event subscriptions of one speaker. The SID and the granted timeout of each service are remembered, so subscriptions are
+ * renewed with their SID shortly before they expire instead of creating new ones. A new subscription is only created when the speaker doesn't
+ * know the SID anymore ("412 Precondition Failed").
+ */
+class SubscriptionManager
+{
+public:
+	struct Subscription
+	{
+		/**
+		 * The event path of the service, e. g. "/MediaRenderer/AVTransport/Event".
+		 */
+		std::string service;
+		std::string sid;
+
+		/**
+		 * The timeout granted by the speaker in seconds.
+		 */
+		int32_t timeout = 0;
+
+		/**
+		 * Times in milliseconds since epoch.
+		 */
+		int64_t expiry = 0;
+		int64_t nextUpdate = 0;
+
+		/**
+		 * Disabled services are unsubscribed on the next update.
+		 */
+		bool enabled = true;
+	};
+
+	struct UpdateResult
+	{
+		/**
+		 * Time in milliseconds until the next subscription needs to be renewed.
+		 */
+		int64_t nextUpdate = 0;
+
+		/**
+		 * True when the speaker answered at least one request.
+		 */
+		bool responded = false;
+
+		/**
+		 * True when the speaker could not be reached.
+		 */
+		bool unreachable = false;
+	};
+
+	/**
+	 * Called when a SID becomes valid ("active" is true) or invalid.
+	 */
+	typedef std::function<void(const std::string& sid, const std::string& service, bool active)> Listener;
+
+	SubscriptionManager(const std::vector<std::string>& services, Listener listener);
+	virtual ~SubscriptionManager() = default;
+
+	/**
+	 * Creates or renews all subscriptions that are due. When the callback URL changed, new subscriptions are created.
+	 *
+	 * @param peerId The id of the peer, used for logging.
+	 * @param httpClientPool The connections to the speaker.
+	 * @param host The speaker's host including the port.
+	 * @param callbackUrl The URL of the event server.
+	 */
+	UpdateResult update(uint64_t peerId, HttpClientPool& httpClientPool, const std::string& host, const std::string& callbackUrl);
+
+	/**
+	 * Cancels all subscriptions, e. g. on shutdown or when the peer is deleted.
+	 */
+	void unsubscribeAll(uint64_t peerId, HttpClientPool& httpClientPool, const std::string& host);
+
+	/**
+	 * Selects the services to subscribe to. Changes are applied on the next update.
+	 *
+	 * @param serviceNames The lower case names of the services, e. g. "avtransport".
+	 */
+	void setEnabledServices(const std::unordered_set<std::string>& serviceNames);
+
+	/**
+	 * @return Returns the name of a service from its event path, e. g. "AVTransport" for "/MediaRenderer/AVTransport/Event".
+	 */
+	static std::string serviceName(const std::string& service);
+
+	/**
+	 * Forgets all SIDs, so the next update creates new subscriptions. Used when the speaker's address changed.
+	 */
+	void reset();
+
+	/**
+	 * @return Returns the number of active subscriptions of enabled services.
+	 */
+	size_t activeCount();
+
+	/**
+	 * @param name The name of the service, e. g. "AVTransport".
+	 * @return Returns true when the service is subscribed and the subscription has not expired, so its variables are kept current by events.
+	 */
+	bool isActive(const std::string& name);
+protected:
+	/**
+	 * Time in milliseconds after which a failed request is retried.
+	 */
+	static const int64_t _retryInterval = 60000;
+
+	/**
+	 * The timeout requested from the speaker in seconds.
+	 */
+	static const int32_t _requestedTimeout = 1800;
+
+	uint64_t _peerId = 0;
+	Listener _listener;
+	std::mutex _subscriptionsMutex;
+	std::string _callbackUrl;
+	std::vector<Subscription> _subscriptions;
+
+	/**
+	 * Sends a request and returns the response code or -1 on connection errors.
+	 */
+	int32_t sendRequest(HttpClientPool& httpClientPool, const std::string& request, BaseLib::Http& response);
+	int32_t subscribe(HttpClientPool& httpClientPool, const std::string& host, const std::string& callbackUrl, Subscription& subscription);
+	int32_t renew(HttpClientPool& httpClientPool, const std::string& host, Subscription& subscription);
+	bool applyResponse(BaseLib::Http& response, Subscription& subscription);
+	void clear();
+	void setSid(Subscription& subscription, const std::string& sid);
+};
+
+}
+
+#endif
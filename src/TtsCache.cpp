@@ -0,0 +1,210 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#include "TtsCache.h"
+#include "GD.h"
+
+#include <gcrypt.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace Sonos
+{
+
+TtsCache::TtsCache()
+{
+	try
+	{
+		_cachePath = GD::bl->settings.tempPath() + "sonos/ttscache/";
+
+		std::string settingName = "ttscachemaxsize";
+		BaseLib::Systems::FamilySettings::PFamilySetting setting = GD::family->getFamilySetting(settingName);
+		if(setting && setting->integerValue >= 0) _maxSize = (int64_t)setting->integerValue * 1048576;
+
+		settingName = "ttscachemaxage";
+		setting = GD::family->getFamilySetting(settingName);
+		if(setting && setting->integerValue > 0) _maxAge = (int64_t)setting->integerValue * 3600;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+std::string TtsCache::getKey(const std::string& ttsProgram, const std::string& language, const std::string& voice, const std::string& engine, const std::string& text)
+{
+	//Separate the fields with a character that can't be part of them, so different combinations never result in the same input.
+	std::string input = ttsProgram + '\0' + language + '\0' + voice + '\0' + engine + '\0' + text;
+	std::vector<uint8_t> digest(gcry_md_get_algo_dlen(GCRY_MD_SHA256));
+	gcry_md_hash_buffer(GCRY_MD_SHA256, digest.data(), input.data(), input.size());
+	return BaseLib::HelperFunctions::getHexString(digest);
+}
+
+std::string TtsCache::findFile(const std::string& key)
+{
+	if(!GD::bl->io.directoryExists(_cachePath)) return "";
+	auto files = GD::bl->io.getFiles(_cachePath, false);
+	for(auto& file : files)
+	{
+		//Files are named "KEY.EXTENSION".
+		if(file.size() > key.size() && file.compare(0, key.size(), key) == 0 && file.at(key.size()) == '.') return file;
+	}
+	return "";
+}
+
+std::string TtsCache::get(const std::string& key)
+{
+	try
+	{
+		if(!enabled() || key.empty()) return "";
+		std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+		std::string file = findFile(key);
+		if(file.empty()) return "";
+		//The modification time is used as time of last use.
+		utime((_cachePath + file).c_str(), nullptr);
+		return "ttscache/" + file;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return "";
+}
+
+std::string TtsCache::put(const std::string& key, const std::string& path)
+{
+	try
+	{
+		if(!enabled() || key.empty()) return "";
+		std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+		if(!GD::bl->io.directoryExists(_cachePath))
+		{
+			if(!GD::bl->io.createDirectory(_cachePath, S_IRWXU | S_IRWXG))
+			{
+				GD::out.printError("Error: Could not create TTS cache directory \"" + _cachePath + '"');
+				return "";
+			}
+		}
+
+		std::string extension;
+		auto slashPosition = path.find_last_of('/');
+		auto dotPosition = path.find_last_of('.');
+		if(dotPosition != std::string::npos && (slashPosition == std::string::npos || dotPosition > slashPosition)) extension = path.substr(dotPosition);
+		if(!BaseLib::HelperFunctions::isAlphaNumeric(extension, std::unordered_set<char>{'.'})) extension.clear();
+		std::string file = key + (extension.empty() ? std::string(".mp3") : extension);
+
+		//The generated file is in the temp directory, too, so it can be moved instead of copied.
+		if(rename(path.c_str(), (_cachePath + file).c_str()) != 0)
+		{
+			GD::out.printWarning("Warning: Could not move TTS audio file \"" + path + "\" into the cache: " + std::string(strerror(errno)));
+			return "";
+		}
+		utime((_cachePath + file).c_str(), nullptr);
+		cleanUpUnlocked();
+		return "ttscache/" + file;
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	return "";
+}
+
+void TtsCache::cleanUp()
+{
+	try
+	{
+		std::lock_guard<std::mutex> cacheGuard(_cacheMutex);
+		cleanUpUnlocked();
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+void TtsCache::cleanUpUnlocked()
+{
+	try
+	{
+		if(!GD::bl->io.directoryExists(_cachePath)) return;
+
+		struct CachedFile
+		{
+			std::string path;
+			int64_t size = 0;
+			int64_t lastUsed = 0;
+		};
+
+		int64_t now = BaseLib::HelperFunctions::getTimeSeconds();
+		int64_t totalSize = 0;
+		std::vector<CachedFile> cachedFiles;
+		auto files = GD::bl->io.getFiles(_cachePath, false);
+		cachedFiles.reserve(files.size());
+		for(auto& file : files)
+		{
+			CachedFile cachedFile;
+			cachedFile.path = _cachePath + file;
+			struct stat fileInfo{};
+			if(stat(cachedFile.path.c_str(), &fileInfo) != 0) continue;
+			cachedFile.size = fileInfo.st_size;
+			cachedFile.lastUsed = fileInfo.st_mtime;
+			//Also delete everything when the cache is disabled.
+			if(!enabled() || now - cachedFile.lastUsed > _maxAge)
+			{
+				if(!GD::bl->io.deleteFile(cachedFile.path)) GD::out.printError("Error: Could not delete cached TTS audio file \"" + cachedFile.path + "\": " + std::string(strerror(errno)));
+				continue;
+			}
+			totalSize += cachedFile.size;
+			cachedFiles.push_back(std::move(cachedFile));
+		}
+
+		if(totalSize <= _maxSize) return;
+		std::sort(cachedFiles.begin(), cachedFiles.end(), [](const CachedFile& a, const CachedFile& b) { return a.lastUsed < b.lastUsed; });
+		for(auto& cachedFile : cachedFiles)
+		{
+			if(totalSize <= _maxSize) break;
+			if(!GD::bl->io.deleteFile(cachedFile.path))
+			{
+				GD::out.printError("Error: Could not delete cached TTS audio file \"" + cachedFile.path + "\": " + std::string(strerror(errno)));
+				continue;
+			}
+			totalSize -= cachedFile.size;
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		GD::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+}
+
+}
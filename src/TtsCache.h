@@ -0,0 +1,106 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Homegear.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+
+#ifndef TTSCACHE_H_
+#define TTSCACHE_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <mutex>
+#include <string>
+
+namespace Sonos
+{
+
+/**
+ * Persistent cache of generated TTS audio files. Files are stored in "sonos/ttscache/" of Homegear's temp directory and are named after the
+ * SHA-256 hash of everything the generated audio depends on (text, language, voice, engine and TTS program). Files not used for longer than
+ * the maximum age are deleted. When the cache grows larger than the maximum size, the least recently used files are deleted.
+ */
+class TtsCache
+{
+public:
+	TtsCache();
+	virtual ~TtsCache() = default;
+
+	/**
+	 * @return Returns false when caching is disabled in sonos.conf.
+	 */
+	bool enabled() { return _maxSize > 0; }
+
+	/**
+	 * Creates the key of a TTS audio file.
+	 */
+	static std::string getKey(const std::string& ttsProgram, const std::string& language, const std::string& voice, const std::string& engine, const std::string& text);
+
+	/**
+	 * Looks up a cached file and marks it as used.
+	 *
+	 * @return Returns the path of the file relative to "sonos/" in the temp directory or an empty string when the file is not cached.
+	 */
+	std::string get(const std::string& key);
+
+	/**
+	 * Moves a generated file into the cache.
+	 *
+	 * @param key The key returned by "getKey()".
+	 * @param path The full path of the generated file. It needs to be within the temp directory.
+	 * @return Returns the path of the cached file relative to "sonos/" in the temp directory or an empty string on errors. The original file
+	 * is left untouched on errors.
+	 */
+	std::string put(const std::string& key, const std::string& path);
+
+	/**
+	 * Deletes files that are too old and the least recently used files when the cache is too large.
+	 */
+	void cleanUp();
+protected:
+	std::mutex _cacheMutex;
+	std::string _cachePath;
+
+	/**
+	 * The maximum size in bytes. "0" disables the cache.
+	 */
+	int64_t _maxSize = 104857600;
+
+	/**
+	 * The maximum time in seconds since a file was last used.
+	 */
+	int64_t _maxAge = 2592000;
+
+	/**
+	 * Returns the file name of a key within the cache directory or an empty string.
+	 */
+	std::string findFile(const std::string& key);
+	void cleanUpUnlocked();
+};
+
+}
+
+#endif